@@ -0,0 +1,5 @@
+#include "pregen_entry.h"
+
+int main(int argc, char **argv) {
+    return run_pregen(argc, argv);
+}
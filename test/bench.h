@@ -0,0 +1,22 @@
+#ifndef VOXELS_BENCH_H
+#define VOXELS_BENCH_H
+
+#include <chrono>
+
+// benchmarks are tagged [.][bench] so they are skipped by default
+// run with `voxels_test [bench]`
+
+/**
+ * @return Mean wall time of a single call in microseconds
+ */
+template<typename F>
+double bench_us(int iterations, F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        f();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+#endif
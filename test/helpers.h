@@ -0,0 +1,34 @@
+#ifndef VOXELS_TEST_HELPERS_H
+#define VOXELS_TEST_HELPERS_H
+
+#include <array>
+#include <cstring>
+#include "catch.hpp"
+#include "world/terrain.h"
+#include "world/generation/generator.h"
+
+// blocks, column opacity and merged sides all match
+inline void require_same_terrain(const ChunkTerrain &a, const ChunkTerrain &b) {
+    REQUIRE(std::memcmp(a.blocks(), b.blocks(), ChunkTerrain::kBlocksSizeBytes) == 0);
+    for (size_t x = 0; x < kChunkWidth; ++x) {
+        for (size_t z = 0; z < kChunkDepth; ++z)
+            REQUIRE(a.column(x, z) == b.column(x, z));
+    }
+    for (int side = 0; side < ChunkNeighbour::kCount; ++side)
+        REQUIRE(a.has_merged_faces(side) == b.has_merged_faces(side));
+}
+
+struct NamedGenerator {
+    const char *name;
+    IGenerator *gen;
+};
+
+// terrain benches are run over, noisy and flat
+inline const std::array<NamedGenerator, 2> &bench_generators() {
+    static NativeGenerator native;
+    static DummyGenerator dummy;
+    static const std::array<NamedGenerator, 2> generators = {{{"noise", &native}, {"flat", &dummy}}};
+    return generators;
+}
+
+#endif
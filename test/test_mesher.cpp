@@ -0,0 +1,170 @@
+#include <cmath>
+#include <iostream>
+#include "catch.hpp"
+#include "bench.h"
+#include "helpers.h"
+#include "config.h"
+#include "world/mesher.h"
+#include "world/generation/generator.h"
+
+const int kWordsPerFace = 6 * kChunkMeshWordsPerVertexInstance;
+
+// total area of all faces in the mesh, in blocks
+static float mesh_area(const ChunkMeshRaw &mesh, size_t words) {
+    float area = 0;
+    for (size_t i = 0; i < words; i += kWordsPerFace) {
+        float v[3][3];
+        for (int vert = 0; vert < 3; ++vert) {
+            unsigned int x, y, z;
+            Face face;
+            BlockType type;
+            unpack_vertex(mesh[i + vert * kChunkMeshWordsPerVertexInstance], x, y, z, face, type);
+            v[vert][0] = x;
+            v[vert][1] = y;
+            v[vert][2] = z;
+        }
+
+        // quad is 2 triangles, so |ab x ac|
+        float ab[3], ac[3];
+        for (int j = 0; j < 3; ++j) {
+            ab[j] = v[1][j] - v[0][j];
+            ac[j] = v[2][j] - v[0][j];
+        }
+        float cx = ab[1] * ac[2] - ab[2] * ac[1];
+        float cy = ab[2] * ac[0] - ab[0] * ac[2];
+        float cz = ab[0] * ac[1] - ab[1] * ac[0];
+        area += std::sqrt(cx * cx + cy * cy + cz * cz);
+    }
+
+    return area;
+}
+
+TEST_CASE("packed vertices", "[mesher]") {
+    unsigned int x, y, z;
+    Face face;
+    BlockType type;
+
+    PackedVertex v = pack_vertex(kChunkWidth, kChunkHeight, kChunkDepth, kBack, BlockType::kMarker);
+    unpack_vertex(v, x, y, z, face, type);
+    REQUIRE(x == kChunkWidth);
+    REQUIRE(y == kChunkHeight);
+    REQUIRE(z == kChunkDepth);
+    REQUIRE(face == kBack);
+    REQUIRE(type == BlockType::kMarker);
+
+    v = pack_vertex(0, 0, 0, kFront, BlockType::kAir);
+    REQUIRE(v == 0);
+
+    v = pack_vertex(3, 40, 9, kTop, BlockType::kGrass);
+    unpack_vertex(v, x, y, z, face, type);
+    REQUIRE(x == 3);
+    REQUIRE(y == 40);
+    REQUIRE(z == 9);
+    REQUIRE(face == kTop);
+    REQUIRE(type == BlockType::kGrass);
+}
+
+TEST_CASE("meshers emit vertices of visible faces", "[mesher]") {
+    auto *terrain = new ChunkTerrain;
+    terrain->set_type({2, 5, 7}, BlockType::kStone);
+    terrain->update_face_visibility();
+
+    ChunkMeshRaw mesh;
+    REQUIRE(mesh_naive(*terrain, mesh) == 6 * kWordsPerFace);
+
+    for (size_t i = 0; i < mesh.size(); ++i) {
+        unsigned int x, y, z;
+        Face face;
+        BlockType type;
+        unpack_vertex(mesh[i], x, y, z, face, type);
+
+        REQUIRE(face == kFaces[i / kWordsPerFace]);
+        REQUIRE(type == BlockType::kStone);
+        REQUIRE((x == 2 || x == 3));
+        REQUIRE((y == 5 || y == 6));
+        REQUIRE((z == 7 || z == 8));
+    }
+
+    delete terrain;
+}
+
+TEST_CASE("greedy meshing", "[mesher]") {
+    auto *terrain = new ChunkTerrain;
+    auto *naive = new ChunkMeshRaw;
+    auto *greedy = new ChunkMeshRaw;
+
+    SECTION("flat floor is a single quad per side") {
+        for (size_t x = 0; x < kChunkWidth; ++x)
+            for (size_t z = 0; z < kChunkDepth; ++z)
+                terrain->set_type({x, 0, z}, BlockType::kStone);
+        terrain->update_face_visibility();
+
+        size_t naive_words = mesh_naive(*terrain, *naive);
+        size_t greedy_words = mesh_greedy(*terrain, *greedy);
+
+        REQUIRE(naive_words == (kChunkWidth * kChunkDepth * 2 + kChunkWidth * 4) * kWordsPerFace);
+        REQUIRE(greedy_words == 6 * kWordsPerFace);
+        REQUIRE(mesh_area(*naive, naive_words) == Approx(mesh_area(*greedy, greedy_words)));
+    }
+
+    SECTION("covers the same area as naive meshing") {
+        srand(99);
+        for (size_t x = 0; x < kChunkWidth; ++x) {
+            for (size_t z = 0; z < kChunkDepth; ++z) {
+                size_t top = 10 + rand() % 20;
+                for (size_t y = 0; y < top; ++y)
+                    terrain->set_type({x, y, z}, y == top - 1 ? BlockType::kGrass : BlockType::kStone);
+            }
+        }
+        terrain->update_face_visibility();
+
+        size_t naive_words = mesh_naive(*terrain, *naive);
+        size_t greedy_words = mesh_greedy(*terrain, *greedy);
+
+        REQUIRE(greedy_words < naive_words);
+        REQUIRE(mesh_area(*naive, naive_words) == Approx(mesh_area(*greedy, greedy_words)));
+    }
+
+    delete greedy;
+    delete naive;
+    delete terrain;
+}
+
+TEST_CASE("greedy meshing vertex count", "[.][bench]") {
+
+    const int kChunks = 8;
+    for (auto &g : bench_generators()) {
+        size_t words[2] = {0, 0};
+        size_t capacity[2] = {0, 0};
+        double us[2] = {0, 0};
+
+        for (int x = 0; x < kChunks; ++x) {
+            for (int z = 0; z < kChunks; ++z) {
+                Chunk chunk(ChunkId(x, z), nullptr);
+                REQUIRE(g.gen->generate(chunk.id(), 50, &chunk) == 0);
+                chunk.post_terrain_update();
+
+                config::MesherType meshers[] = {config::kMesherNaive, config::kMesherGreedy};
+                for (int m = 0; m < 2; ++m) {
+                    config::kMesher = meshers[m];
+
+                    // each remesh hinted with the last size, as the loader does
+                    ChunkMeshRaw mesh;
+                    size_t size = 0;
+                    us[m] += bench_us(10, [&]() { size = Chunk::build_mesh(chunk.terrain(), mesh, size); });
+                    words[m] += size;
+                    capacity[m] += mesh.capacity();
+                }
+            }
+        }
+
+        size_t verts_naive = words[0] / kChunkMeshWordsPerVertexInstance;
+        size_t verts_greedy = words[1] / kChunkMeshWordsPerVertexInstance;
+        std::cout << g.name << ": naive " << verts_naive << " vertices, " << us[0] / (kChunks * kChunks) << "us/chunk; "
+                  << "greedy " << verts_greedy << " vertices, " << us[1] / (kChunks * kChunks) << "us/chunk" << std::endl;
+        std::cout << g.name << ": mesh buffers naive " << (capacity[0] * sizeof(int32_t)) / (kChunks * kChunks * 1024)
+                  << " KB/chunk, greedy " << (capacity[1] * sizeof(int32_t)) / (kChunks * kChunks * 1024)
+                  << " KB/chunk (worst case " << (kChunkMeshSize * sizeof(int32_t)) / 1024 << " KB)" << std::endl;
+        REQUIRE(verts_greedy <= verts_naive);
+    }
+}
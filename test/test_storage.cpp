@@ -0,0 +1,467 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <dirent.h>
+#include <unistd.h>
+#include <vector>
+#include "bench.h"
+#include "catch.hpp"
+#include "helpers.h"
+#include "config.h"
+#include "error.h"
+#include "world/generation/generator.h"
+#include "world/storage/pack.h"
+#include "world/storage/pregen.h"
+#include "world/storage/record.h"
+#include "world/storage/region.h"
+
+// fresh empty directory under /tmp, removed with everything in it at the end of the scope
+struct TempDirectory {
+    std::string path_;
+
+    TempDirectory() {
+        char path[] = "/tmp/voxels_test_XXXXXX";
+        REQUIRE(mkdtemp(path) != nullptr);
+        path_ = path;
+    }
+
+    ~TempDirectory() {
+        DIR *dir = opendir(path_.c_str());
+        if (dir == nullptr)
+            return;
+
+        // only ever files
+        while (struct dirent *entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+                unlink((path_ + "/" + entry->d_name).c_str());
+        }
+        closedir(dir);
+        rmdir(path_.c_str());
+    }
+};
+
+static void generate(Chunk *chunk) {
+    DummyGenerator dummy;
+    IGenerator &gen = dummy;
+    REQUIRE(gen.generate(chunk->id(), 50, chunk) == kErrorSuccess);
+}
+
+TEST_CASE("region file", "[storage]") {
+    TempDirectory directory;
+    std::string path = directory.path_ + "/r.-1.0.vxr";
+
+    SECTION("coords") {
+        int rx, rz;
+        RegionFile::region_of(ChunkId(-1, 31), rx, rz);
+        REQUIRE(rx == -1);
+        REQUIRE(rz == 0);
+        REQUIRE(RegionFile::index_of(ChunkId(-1, 31)) == 31 * RegionFile::kSize + 31);
+        REQUIRE(RegionFile::index_of(ChunkId(-32, 0)) == 0);
+    }
+
+    SECTION("missing file is not created unless asked") {
+        RegionFile file;
+        REQUIRE(file.open(path, false) == kErrorIo);
+    }
+
+    SECTION("round trip") {
+        std::vector<uint8_t> a(100, 'a'), b(3000, 'b'), c(50, 'c'), out;
+        {
+            RegionFile file;
+            REQUIRE(file.open(path, true) == kErrorSuccess);
+            REQUIRE(file.write(ChunkId(-1, 0), a.data(), a.size()) == kErrorSuccess);
+            REQUIRE(file.write(ChunkId(-32, 31), b.data(), b.size()) == kErrorSuccess);
+
+            // overwritten
+            REQUIRE(file.write(ChunkId(-1, 0), c.data(), c.size()) == kErrorSuccess);
+        }
+
+        RegionFile file;
+        REQUIRE(file.open(path, false) == kErrorSuccess);
+
+        REQUIRE(file.read(ChunkId(-1, 0), out) == kErrorSuccess);
+        REQUIRE(out == c);
+        REQUIRE(file.read(ChunkId(-32, 31), out) == kErrorSuccess);
+        REQUIRE(out == b);
+
+        REQUIRE_FALSE(file.contains(ChunkId(-2, 0)));
+        REQUIRE(file.read(ChunkId(-2, 0), out) == kErrorSuccess);
+        REQUIRE(out.empty());
+    }
+
+    SECTION("batch") {
+        std::vector<uint8_t> a(100, 'a'), b(3000, 'b'), c(50, 'c'), out;
+        {
+            RegionFile file;
+            REQUIRE(file.open(path, true) == kErrorSuccess);
+            REQUIRE(file.write(ChunkId(-1, 0), a.data(), a.size()) == kErrorSuccess);
+
+            RegionFile::Write writes[] = {{ChunkId(-1, 0),  c.data(), c.size()},
+                                          {ChunkId(-32, 31), b.data(), b.size()}};
+            REQUIRE(file.write(writes, 2) == kErrorSuccess);
+        }
+
+        RegionFile file;
+        REQUIRE(file.open(path, false) == kErrorSuccess);
+        REQUIRE(file.read(ChunkId(-1, 0), out) == kErrorSuccess);
+        REQUIRE(out == c);
+        REQUIRE(file.read(ChunkId(-32, 31), out) == kErrorSuccess);
+        REQUIRE(out == b);
+    }
+}
+
+TEST_CASE("chunk record", "[storage]") {
+    Chunk chunk(ChunkId(0, 0), nullptr), neighbour(ChunkId(1, 0), nullptr);
+    generate(&chunk);
+    generate(&neighbour);
+    chunk.post_terrain_update();
+    neighbour.post_terrain_update();
+    chunk.merge_faces_with_neighbour(&neighbour, ChunkNeighbour::kBack);
+
+    std::vector<uint8_t> record;
+    ChunkRecord::encode(chunk.terrain(), record);
+
+    ChunkTerrain restored;
+
+    SECTION("round trip keeps post processing and merged sides") {
+        REQUIRE(ChunkRecord::decode(record.data(), record.size(), restored) == kErrorSuccess);
+        require_same_terrain(restored, chunk.terrain());
+        REQUIRE(restored.has_merged_faces(ChunkNeighbour::kBack));
+
+        // border opacity is restored too, so neighbours merge the same
+        ChunkTerrain a = neighbour.terrain(), b = neighbour.terrain();
+        a.merge_faces(chunk.terrain(), ChunkNeighbour::kFront);
+        b.merge_faces(restored, ChunkNeighbour::kFront);
+        require_same_terrain(a, b);
+    }
+
+    SECTION("bad records are rejected") {
+        REQUIRE(ChunkRecord::decode(record.data(), record.size() - 1, restored) == kErrorFormat);
+
+        // no header
+        const auto *blocks = reinterpret_cast<const uint8_t *>(neighbour.terrain().blocks());
+        std::vector<uint8_t> raw(blocks, blocks + ChunkTerrain::kBlocksSizeBytes);
+        REQUIRE(ChunkRecord::decode(raw.data(), raw.size(), restored) == kErrorFormat);
+
+        record[4]++; // version
+        REQUIRE(ChunkRecord::decode(record.data(), record.size(), restored) == kErrorFormat);
+    }
+}
+
+TEST_CASE("chunk record restore", "[.][bench]") {
+    Chunk chunk(ChunkId(0, 0), nullptr);
+    ChunkTerrain restored;
+    generate(&chunk);
+
+    ChunkTerrain raw = chunk.terrain();
+    std::vector<uint8_t> record;
+    chunk.post_terrain_update();
+    ChunkRecord::encode(chunk.terrain(), record);
+
+    // what restoring only the blocks would cost, post processing them all over again
+    double raw_us = bench_us(200, [&]() {
+        restored = raw;
+        restored.rebuild_opacity();
+        restored.update_face_visibility();
+        restored.populate_neighbour_opacity();
+    });
+    double record_us = bench_us(200, [&]() { ChunkRecord::decode(record.data(), record.size(), restored); });
+    std::cout << "raw blocks " << raw_us << "us, record " << record_us << "us (" << raw_us / record_us << "x), "
+              << record.size() << " bytes" << std::endl;
+}
+
+TEST_CASE("region store", "[storage]") {
+    TempDirectory temp;
+    const std::string &directory = temp.path_;
+
+    // fails rather than hangs if the I/O thread never answers
+    std::atomic_int loaded(0), missing(0);
+    auto wait_for = [&](int expected) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (loaded + missing < expected && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+        REQUIRE(loaded + missing >= expected);
+    };
+
+    RegionStore store(directory, [&](Chunk *) { loaded++; }, [&](ChunkId_t, const CancellationTokenPtr &) { missing++; });
+
+    // far apart, in different regions
+    Chunk saved(ChunkId(5, -3), nullptr), other(ChunkId(-100, 70), nullptr);
+    generate(&saved);
+    generate(&other);
+    store.save(&saved);
+    store.save(&other);
+
+    Chunk restored(ChunkId(5, -3), nullptr);
+    store.load(&restored, std::make_shared<CancellationToken>());
+    wait_for(1);
+    REQUIRE(loaded == 1);
+    REQUIRE(std::memcmp(restored.terrain().blocks(), saved.terrain().blocks(), ChunkTerrain::kBlocksSizeBytes) == 0);
+
+    SECTION("missing chunks are reported and untouched") {
+        Chunk never(ChunkId(6, -3), nullptr);
+        auto token = std::make_shared<CancellationToken>();
+        store.load(&never, token);
+        wait_for(2);
+        REQUIRE(missing == 1);
+
+        // can still be generated with the same token
+        REQUIRE(token->begin());
+    }
+
+    SECTION("cancelled loads are dropped") {
+        Chunk cancelled(ChunkId(-100, 70), nullptr);
+        auto token = std::make_shared<CancellationToken>();
+        token->cancel();
+        store.load(&cancelled, token);
+
+        // loads are handled in order
+        Chunk after(ChunkId(-100, 70), nullptr);
+        store.load(&after, std::make_shared<CancellationToken>());
+        wait_for(2);
+        REQUIRE(loaded == 2);
+        REQUIRE(missing == 0);
+    }
+
+    SECTION("discarded") {
+        store.discard_all();
+        Chunk gone(ChunkId(5, -3), nullptr);
+        store.load(&gone, std::make_shared<CancellationToken>());
+        wait_for(2);
+        REQUIRE(missing == 1);
+    }
+
+    SECTION("clean chunks are not saved") {
+        Chunk clean(ChunkId(6, -3), nullptr);
+        REQUIRE_FALSE(clean.dirty());
+        store.save(&clean);
+        store.flush();
+
+        store.load(&clean, std::make_shared<CancellationToken>());
+        wait_for(2);
+        REQUIRE(missing == 1);
+    }
+
+    SECTION("flushed to disk in region batches") {
+        // a region and a bit, saved twice over
+        std::vector<Chunk *> chunks;
+        for (int i = 0; i < RegionFile::kSize + 4; ++i) {
+            chunks.push_back(new Chunk(ChunkId(i, 0), nullptr));
+            generate(chunks.back());
+        }
+        for (int round = 0; round < 2; ++round) {
+            for (Chunk *chunk : chunks)
+                store.save(chunk);
+        }
+
+        store.flush();
+        REQUIRE(store.pending() == 0);
+
+        RegionFile first, second;
+        REQUIRE(first.open(directory + "/r.0.0.vxr", false) == kErrorSuccess);
+        REQUIRE(second.open(directory + "/r.1.0.vxr", false) == kErrorSuccess);
+        for (Chunk *chunk : chunks) {
+            int x, z;
+            ChunkId_deconstruct(chunk->id(), x, z);
+            REQUIRE((x < RegionFile::kSize ? first : second).contains(chunk->id()));
+            delete chunk;
+        }
+    }
+}
+
+TEST_CASE("pregeneration", "[storage]") {
+    PregenOptions options{};
+    options.min_x_ = -3;
+    options.min_z_ = -1;
+    options.max_x_ = 2;
+    options.max_z_ = 30; // regions -1 and 0 on both axes
+    options.seed_ = 50;
+    options.generator_ = config::kFlat;
+    TempDirectory directory;
+    options.directory_ = directory.path_;
+    options.threads_ = 2;
+    options.batch_size_ = 3;
+
+    std::atomic_int generators(0);
+    auto new_generator = [&generators]() -> IGenerator * {
+        generators++;
+        return new DummyGenerator;
+    };
+
+    PregenProgress progress;
+    REQUIRE(pregenerate(options, new_generator, progress) == kErrorSuccess);
+    REQUIRE(progress.total_ == 6 * 32);
+    REQUIRE(progress.generated_ == progress.total_);
+    REQUIRE(progress.skipped_ == 0);
+    REQUIRE(progress.failed_ == 0);
+    REQUIRE(generators <= 2);
+
+    SECTION("stored post processed") {
+        RegionFile file;
+        REQUIRE(file.open(options.directory_ + "/" + RegionFile::file_name(-1, -1), false) == kErrorSuccess);
+
+        std::vector<uint8_t> data;
+        REQUIRE(file.read(ChunkId(-2, -1), data) == kErrorSuccess);
+
+        // merged with its neighbours in the same task, as the loader would
+        Chunk front(ChunkId(-3, -1), nullptr), expected(ChunkId(-2, -1), nullptr), back(ChunkId(-1, -1), nullptr);
+        for (Chunk *chunk : {&front, &expected, &back}) {
+            generate(chunk);
+            chunk->post_terrain_update();
+        }
+        expected.merge_faces_with_neighbour(&front, ChunkNeighbour::kFront);
+        expected.merge_faces_with_neighbour(&back, ChunkNeighbour::kBack);
+
+        ChunkTerrain restored;
+        REQUIRE(ChunkRecord::decode(data.data(), data.size(), restored) == kErrorSuccess);
+        require_same_terrain(restored, expected.terrain());
+    }
+
+    SECTION("resumed") {
+        // as if interrupted, one region was lost
+        REQUIRE(unlink((options.directory_ + "/" + RegionFile::file_name(0, 0)).c_str()) == 0);
+
+        REQUIRE(pregenerate(options, new_generator, progress) == kErrorSuccess);
+        REQUIRE(progress.skipped_ == 3 * 32 + 3);
+        REQUIRE(progress.generated_ == progress.total_ - progress.skipped_);
+
+        REQUIRE(pregenerate(options, new_generator, progress) == kErrorSuccess);
+        REQUIRE(progress.skipped_ == progress.total_);
+        REQUIRE(progress.generated_ == 0);
+    }
+
+    SECTION("packed") {
+        std::string path = options.directory_ + "/spawn.pack";
+        size_t packed;
+        REQUIRE(pack_stored(options, path, packed) == kErrorSuccess);
+        REQUIRE(packed == progress.total_);
+
+        WorldPack pack;
+        REQUIRE(pack.open(path) == kErrorSuccess);
+        REQUIRE(pack.size() == progress.total_);
+        REQUIRE(pack.seed() == 50);
+        REQUIRE(pack.generator() == config::kFlat);
+        REQUIRE(pack.contains(ChunkId(-1, -1)));
+        REQUIRE(pack.contains(ChunkId(2, 30)));
+        REQUIRE_FALSE(pack.contains(ChunkId(3, 30)));
+
+        RegionFile file;
+        REQUIRE(file.open(options.directory_ + "/" + RegionFile::file_name(-1, 0), false) == kErrorSuccess);
+        std::vector<uint8_t> data;
+        REQUIRE(file.read(ChunkId(-3, 10), data) == kErrorSuccess);
+
+        ChunkTerrain expected;
+        REQUIRE(ChunkRecord::decode(data.data(), data.size(), expected) == kErrorSuccess);
+
+        Chunk chunk(ChunkId(-3, 10), nullptr);
+        REQUIRE(pack.load(&chunk) == kErrorSuccess);
+        require_same_terrain(chunk.terrain(), expected);
+        REQUIRE_FALSE(chunk.dirty());
+    }
+}
+
+TEST_CASE("world pack", "[storage]") {
+    TempDirectory temp;
+    const std::string &directory = temp.path_;
+    std::string path = directory + "/world.pack";
+
+    std::vector<Chunk *> chunks;
+    for (int x = -2; x <= 2; ++x) {
+        for (int z = -2; z <= 2; ++z) {
+            Chunk *chunk = new Chunk(ChunkId(x, z), nullptr);
+            generate(chunk);
+            chunk->post_terrain_update();
+            chunks.push_back(chunk);
+        }
+    }
+
+    // added out of order, the index is sorted
+    {
+        WorldPackWriter writer;
+        REQUIRE(writer.open(path, 50, config::kNoise) == kErrorSuccess);
+        for (auto it = chunks.rbegin(); it != chunks.rend(); ++it)
+            REQUIRE(writer.add(*it) == kErrorSuccess);
+        REQUIRE(writer.finish() == kErrorSuccess);
+    }
+
+    SECTION("round trip") {
+        WorldPack pack;
+        REQUIRE(pack.open(path) == kErrorSuccess);
+        REQUIRE(pack.size() == chunks.size());
+        REQUIRE(pack.seed() == 50);
+        REQUIRE(pack.generator() == config::kNoise);
+
+        for (Chunk *chunk : chunks) {
+            Chunk restored(chunk->id(), nullptr);
+            REQUIRE(pack.contains(chunk->id()));
+            REQUIRE(pack.load(&restored) == kErrorSuccess);
+            require_same_terrain(restored.terrain(), chunk->terrain());
+        }
+
+        Chunk missing(ChunkId(3, 0), nullptr);
+        REQUIRE_FALSE(pack.contains(missing.id()));
+        REQUIRE(pack.load(&missing) == kErrorFormat);
+    }
+
+    SECTION("duplicates are rejected and nothing is replaced") {
+        {
+            WorldPackWriter writer;
+            REQUIRE(writer.open(path, 50, config::kNoise) == kErrorSuccess);
+            REQUIRE(writer.add(chunks[0]) == kErrorSuccess);
+            REQUIRE(writer.add(chunks[0]) == kErrorSuccess);
+            REQUIRE(writer.finish() == kErrorFormat);
+        }
+
+        REQUIRE(access((path + ".tmp").c_str(), F_OK) != 0);
+
+        WorldPack pack;
+        REQUIRE(pack.open(path) == kErrorSuccess);
+        REQUIRE(pack.size() == chunks.size());
+    }
+
+    SECTION("bad packs are rejected") {
+        WorldPack pack;
+        REQUIRE(pack.open(directory + "/nope.pack") == kErrorIo);
+
+        FILE *f = fopen(path.c_str(), "r+b");
+        REQUIRE(f != nullptr);
+        fputc('X', f); // magic
+        fclose(f);
+        REQUIRE(pack.open(path) == kErrorFormat);
+    }
+
+    for (Chunk *chunk : chunks)
+        delete chunk;
+}
+
+TEST_CASE("world pack load", "[.][bench]") {
+    TempDirectory directory;
+    std::string path = directory.path_ + "/world.pack";
+    NativeGenerator native;
+    IGenerator &gen = native;
+
+    Chunk chunk(ChunkId(0, 0), nullptr);
+    REQUIRE(gen.generate(chunk.id(), 50, &chunk) == kErrorSuccess);
+    chunk.post_terrain_update();
+
+    WorldPackWriter writer;
+    REQUIRE(writer.open(path, 50, config::kNoise) == kErrorSuccess);
+    REQUIRE(writer.add(&chunk) == kErrorSuccess);
+    REQUIRE(writer.finish() == kErrorSuccess);
+
+    WorldPack pack;
+    REQUIRE(pack.open(path) == kErrorSuccess);
+
+    Chunk restored(chunk.id(), nullptr);
+    double generate_us = bench_us(50, [&]() {
+        gen.generate(restored.id(), 50, &restored);
+        restored.post_terrain_update();
+    });
+    double pack_us = bench_us(200, [&]() { pack.load(&restored); });
+    std::cout << "generate " << generate_us << "us, pack " << pack_us << "us (" << generate_us / pack_us << "x)"
+              << std::endl;
+}
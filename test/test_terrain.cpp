@@ -0,0 +1,387 @@
+#include <atomic>
+#include <bitset>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+#include "bench.h"
+#include "helpers.h"
+#include "error.h"
+#include "threadpool.h"
+#include "world/chunk.h"
+#include "world/generation/generator.h"
+#include "world/terrain_codec.h"
+
+TEST_CASE("packed blocks", "[terrain]") {
+    SECTION("size") {
+        REQUIRE(sizeof(Block) == 2);
+        REQUIRE(ChunkTerrain::kBlocksSizeBytes == kBlocksPerChunk * 2);
+    }
+
+    SECTION("face visibility") {
+        FaceVisibility vis;
+        REQUIRE(vis.invisible());
+
+        vis.set_face_visible(kTop, true);
+        vis.set_face_visible(kBack, true);
+        REQUIRE(vis.visible(kTop));
+        REQUIRE(vis.visible(kBack));
+        REQUIRE(!vis.visible(kFront));
+        REQUIRE(vis.mask() == ((1 << kTop) | (1 << kBack)));
+
+        vis.set_face_visible(kTop, false);
+        REQUIRE(!vis.visible(kTop));
+        REQUIRE(vis.visible(kBack));
+
+        vis.set_fully_visible();
+        for (Face f : kFaces)
+            REQUIRE(vis.visible(f));
+    }
+
+    SECTION("block type is independent of faces") {
+        Block b(BlockType::kStone);
+        b.face_visibility_.set_fully_visible();
+        REQUIRE(b.type_ == BlockType::kStone);
+        REQUIRE(b.face_visibility_.mask() == FaceVisibility::kAllVisible);
+    }
+}
+
+// the scalar per-block, per-face algorithm the column masks replaced
+static FaceVisibility reference_visibility(ChunkTerrain &terrain, const ChunkTerrain::BlockCoord &pos) {
+    FaceVisibility vis;
+    if (!BlockType_opaque(terrain[pos].type_)) {
+        vis.set_fully_visible();
+        return vis;
+    }
+
+    for (Face face : kFaces) {
+        ChunkTerrain::BlockCoord offset = pos;
+        face_offset(face, offset.data_);
+
+        if (offset[0] >= kChunkWidth || offset[1] >= kChunkHeight || offset[2] >= kChunkDepth) {
+            // underflow wraps around too
+            vis.set_face_visible(face, true);
+            continue;
+        }
+
+        vis.set_face_visible(face, !BlockType_opaque(terrain[offset].type_));
+    }
+    return vis;
+}
+
+static void random_terrain(ChunkTerrain &terrain, unsigned int seed) {
+    srand(seed);
+    for (int i = 0; i < kBlocksPerChunk; ++i)
+        terrain.set_type(i, rand() % 3 == 0 ? BlockType::kAir : BlockType::kStone);
+}
+
+TEST_CASE("column opacity face culling", "[terrain]") {
+    auto *terrain = new ChunkTerrain;
+    random_terrain(*terrain, 1234);
+
+    SECTION("set_type keeps columns in sync") {
+        ChunkTerrain::ColumnMask before = terrain->column(3, 7);
+        terrain->rebuild_opacity();
+        REQUIRE(terrain->column(3, 7) == before);
+
+        terrain->set_type({3, 10, 7}, BlockType::kGrass);
+        REQUIRE(((terrain->column(3, 7) >> 10u) & 1u) == 1);
+        terrain->set_type({3, 10, 7}, BlockType::kAir);
+        REQUIRE(((terrain->column(3, 7) >> 10u) & 1u) == 0);
+    }
+
+    SECTION("matches scalar culling") {
+        terrain->update_face_visibility();
+
+        ChunkTerrain::BlockCoord pos;
+        for (int i = 0; i < kBlocksPerChunk; ++i) {
+            terrain->expand(i, pos);
+            FaceVisibility expected = reference_visibility(*terrain, pos);
+            REQUIRE((int) (*terrain)[i].face_visibility_.mask() == (int) expected.mask());
+        }
+    }
+
+    SECTION("merging with a solid neighbour hides the border") {
+        auto *neighbour = new ChunkTerrain;
+        for (int i = 0; i < kBlocksPerChunk; ++i)
+            neighbour->set_type(i, BlockType::kStone);
+        neighbour->populate_neighbour_opacity();
+
+        terrain->update_face_visibility();
+        terrain->merge_faces(*neighbour, ChunkNeighbour::kBack);
+        REQUIRE(terrain->has_merged_faces(ChunkNeighbour::kBack));
+
+        for (size_t y = 0; y < kChunkHeight; ++y)
+            for (size_t z = 0; z < kChunkDepth; ++z)
+                REQUIRE(!(*terrain)[{kChunkWidth - 1, y, z}].face_visibility_.visible(kBack));
+
+        delete neighbour;
+    }
+
+    delete terrain;
+}
+
+// the old layout, with a bitset that takes a whole word
+struct BitsetBlock {
+    BlockType type_;
+    std::bitset<kFaceCount> face_visibility_;
+};
+
+TEST_CASE("block layout memory", "[.][bench]") {
+    const int kChunks = 128 + loaded_radius_chunk_count(5); // default cache + radius
+
+    std::vector<BitsetBlock> old_layout(kBlocksPerChunk);
+    ChunkTerrain *new_layout = new ChunkTerrain;
+
+    size_t old_bytes = sizeof(BitsetBlock) * kBlocksPerChunk;
+    size_t new_bytes = sizeof(ChunkTerrain);
+
+    std::cout << "bitset block: " << sizeof(BitsetBlock) << " bytes, "
+              << old_bytes / 1024 << " KB per chunk, "
+              << (old_bytes * kChunks) / (1024 * 1024) << " MB for " << kChunks << " chunks" << std::endl;
+    std::cout << "packed block: " << sizeof(Block) << " bytes, "
+              << new_bytes / 1024 << " KB per chunk, "
+              << (new_bytes * kChunks) / (1024 * 1024) << " MB for " << kChunks << " chunks" << std::endl;
+
+    // full scan of faces, as the mesher does
+    volatile int sink = 0;
+    double old_us = bench_us(200, [&]() {
+        int n = 0;
+        for (const BitsetBlock &b : old_layout)
+            n += b.face_visibility_.any();
+        sink = n;
+    });
+    double new_us = bench_us(200, [&]() {
+        int n = 0;
+        const Block *blocks = new_layout->blocks();
+        for (int i = 0; i < kBlocksPerChunk; ++i)
+            n += !blocks[i].face_visibility_.invisible();
+        sink = n;
+    });
+
+    std::cout << "scan: bitset " << old_us << "us, packed " << new_us << "us" << std::endl;
+    REQUIRE(new_bytes < old_bytes);
+
+    delete new_layout;
+}
+
+TEST_CASE("region generation", "[terrain]") {
+    const int n = 3;
+    DummyGenerator dummy;
+    IGenerator &gen = dummy;
+
+    // one hole, skipped
+    std::vector<Chunk *> region(n * n), single(n * n);
+    for (int i = 0; i < n * n; ++i) {
+        if (i == 4)
+            continue;
+        ChunkId_t id = ChunkId(-1 + i / n, 5 + i % n);
+        region[i] = new Chunk(id, nullptr);
+        single[i] = new Chunk(id, nullptr);
+    }
+
+    std::vector<int> results(n * n, -1);
+    REQUIRE(gen.generate_region(ChunkId(-1, 5), n, 50, region.data(), results.data()) == kErrorSuccess);
+    REQUIRE(results[4] == -1);
+
+    for (int i = 0; i < n * n; ++i) {
+        if (single[i] == nullptr)
+            continue;
+
+        REQUIRE(results[i] == kErrorSuccess);
+        REQUIRE(gen.generate(single[i]->id(), 50, single[i]) == kErrorSuccess);
+        REQUIRE(std::memcmp(region[i]->terrain().blocks(), single[i]->terrain().blocks(),
+                            ChunkTerrain::kBlocksSizeBytes) == 0);
+
+        region[i]->post_terrain_update();
+    }
+
+    Chunk::merge_region(region.data(), n);
+
+    // corner has neighbours within the region behind and to the right only
+    const ChunkTerrain &corner = region[0]->terrain();
+    REQUIRE_FALSE(corner.has_merged_faces(ChunkNeighbour::kFront));
+    REQUIRE_FALSE(corner.has_merged_faces(ChunkNeighbour::kLeft));
+    REQUIRE(corner.has_merged_faces(ChunkNeighbour::kRight));
+    REQUIRE(corner.has_merged_faces(ChunkNeighbour::kBack));
+
+    // next to the hole
+    REQUIRE_FALSE(region[1]->terrain().has_merged_faces(ChunkNeighbour::kBack));
+
+    for (int i = 0; i < n * n; ++i) {
+        delete region[i];
+        delete single[i];
+    }
+}
+
+TEST_CASE("region batched generation", "[.][bench]") {
+
+    // a load radius of 7 or so
+    const int kSide = 16;
+    const int kBatchSizes[] = {1, 2, 4, 8};
+    ThreadPool pool(ThreadPool::hardware_concurrency(), kSchedulingWorkStealing);
+
+    std::vector<Chunk *> chunks(kSide * kSide);
+    for (int i = 0; i < kSide * kSide; ++i)
+        chunks[i] = new Chunk(ChunkId(i / kSide, i % kSide), nullptr);
+
+    for (auto &g : bench_generators()) {
+        for (int n : kBatchSizes) {
+            double us = bench_us(5, [&]() {
+                std::atomic_int done(0);
+                int tasks = 0;
+
+                for (int rx = 0; rx < kSide; rx += n) {
+                    for (int rz = 0; rz < kSide; rz += n) {
+                        pool.post([&, rx, rz]() {
+                            std::vector<Chunk *> region(n * n);
+                            for (int i = 0; i < n * n; ++i)
+                                region[i] = chunks[(rx + i / n) * kSide + rz + i % n];
+
+                            std::vector<int> results(n * n);
+                            g.gen->generate_region(ChunkId(rx, rz), n, 50, region.data(), results.data());
+                            for (Chunk *chunk : region) {
+                                chunk->post_terrain_update();
+                                chunk->reset_for_cache();
+                            }
+                            Chunk::merge_region(region.data(), n);
+                            done++;
+                        });
+                        tasks++;
+                    }
+                }
+
+                while (done < tasks)
+                    std::this_thread::yield();
+            });
+
+            std::cout << g.name << ": batch " << n << "x" << n << " " << (kSide * kSide) / (us / 1e6)
+                      << " chunks/s" << std::endl;
+        }
+    }
+
+    for (Chunk *chunk : chunks)
+        delete chunk;
+}
+
+// chunk with every column different, to stress the palette and runs
+static void random_terrain(ChunkTerrain &terrain) {
+    srand(1234);
+    for (int i = 0; i < kBlocksPerChunk; ++i) {
+        Block &block = terrain[i];
+        block.type_ = static_cast<BlockType>(rand() % kBlockTypeCount);
+        block.face_visibility_ = FaceVisibility((rand() % 4) == 0 ? rand() % (FaceVisibility::kAllVisible + 1) : 0);
+    }
+    terrain.rebuild_opacity();
+}
+
+TEST_CASE("terrain codec", "[terrain]") {
+    Chunk chunk(ChunkId(3, -2), nullptr);
+    DummyGenerator dummy;
+    IGenerator &gen = dummy;
+    REQUIRE(gen.generate(chunk.id(), 50, &chunk) == kErrorSuccess);
+    chunk.post_terrain_update();
+
+    auto *random = new ChunkTerrain;
+    random_terrain(*random);
+
+    auto *decoded = new ChunkTerrain;
+    std::vector<uint8_t> encoded;
+
+    for (const ChunkTerrain *terrain : {&chunk.terrain(), static_cast<const ChunkTerrain *>(random)}) {
+        encoded.clear();
+        TerrainEncoder::encode(*terrain, encoded);
+
+        // round trip
+        REQUIRE(TerrainDecoder::decode(encoded.data(), encoded.size(), *decoded) == kErrorSuccess);
+        require_same_terrain(*decoded, *terrain);
+
+        // streamed in uneven pieces
+        {
+            TerrainEncoder encoder(*terrain);
+            TerrainDecoder decoder(*decoded);
+            std::vector<uint8_t> streamed;
+
+            uint8_t buf[7];
+            while (size_t n = encoder.read(buf, sizeof(buf))) {
+                streamed.insert(streamed.end(), buf, buf + n);
+
+                // fed back in even smaller pieces
+                for (size_t i = 0; i < n; i += 3)
+                    REQUIRE(decoder.write(buf + i, std::min<size_t>(3, n - i)) == kErrorSuccess);
+            }
+
+            REQUIRE(encoder.done());
+            REQUIRE(decoder.done());
+            REQUIRE(streamed == encoded);
+            require_same_terrain(*decoded, *terrain);
+        }
+
+        // malformed
+        {
+            REQUIRE(TerrainDecoder::decode(encoded.data(), encoded.size() - 1, *decoded) == kErrorFormat);
+
+            encoded.push_back(0);
+            REQUIRE(TerrainDecoder::decode(encoded.data(), encoded.size(), *decoded) == kErrorFormat);
+            encoded.pop_back();
+
+            // a run off the top of the first column
+            size_t palette_len = encoded[0] | (encoded[1] << 8);
+            encoded[2 + palette_len * 2 + 1] = kChunkHeight + 1;
+            REQUIRE(TerrainDecoder::decode(encoded.data(), encoded.size(), *decoded) == kErrorFormat);
+        }
+    }
+
+    // flat terrain is a handful of runs per column
+    encoded.clear();
+    TerrainEncoder::encode(chunk.terrain(), encoded);
+    REQUIRE(encoded.size() < ChunkTerrain::kBlocksSizeBytes / 10);
+
+    delete random;
+    delete decoded;
+}
+
+TEST_CASE("terrain codec throughput", "[.][bench]") {
+
+    const int kChunks = 64;
+    std::vector<Chunk *> chunks(kChunks);
+    auto *decoded = new ChunkTerrain;
+    std::vector<std::vector<uint8_t>> encoded(kChunks);
+
+    for (auto &g : bench_generators()) {
+        // fresh chunks, generators only write non air blocks
+        for (int i = 0; i < kChunks; ++i) {
+            delete chunks[i];
+            chunks[i] = new Chunk(ChunkId(i / 8, i % 8), nullptr);
+            REQUIRE(g.gen->generate(chunks[i]->id(), 50, chunks[i]) == kErrorSuccess);
+            chunks[i]->post_terrain_update();
+        }
+
+        double encode_us = bench_us(10, [&]() {
+            for (int i = 0; i < kChunks; ++i) {
+                encoded[i].clear();
+                TerrainEncoder::encode(chunks[i]->terrain(), encoded[i]);
+            }
+        });
+
+        double decode_us = bench_us(10, [&]() {
+            for (int i = 0; i < kChunks; ++i)
+                TerrainDecoder::decode(encoded[i].data(), encoded[i].size(), *decoded);
+        });
+
+        size_t raw_bytes = kChunks * ChunkTerrain::kBlocksSizeBytes, encoded_bytes = 0;
+        for (auto &e : encoded)
+            encoded_bytes += e.size();
+
+        // throughput in terms of raw block bytes
+        std::cout << g.name << ": encode " << raw_bytes / encode_us << " MB/s, decode " << raw_bytes / decode_us
+                  << " MB/s, ratio " << double(raw_bytes) / encoded_bytes << " (" << encoded_bytes / kChunks
+                  << " bytes per chunk)" << std::endl;
+    }
+
+    delete decoded;
+    for (Chunk *chunk : chunks)
+        delete chunk;
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+#include "threadpool.h"
+
+// blocks the only worker until released, so tasks pile up in the queue
+struct BlockedPool {
+    ThreadPool pool_;
+    std::promise<void> release_;
+
+    BlockedPool(SchedulingMode mode = kSchedulingShared) : pool_(1, mode) {
+        std::promise<void> started;
+        std::shared_future<void> release = release_.get_future().share();
+        pool_.post([&started, release]() {
+            started.set_value();
+            release.wait();
+        }, 0);
+        started.get_future().wait();
+    }
+
+    void release_and_wait(std::atomic_int &done, int expected) {
+        release_.set_value();
+        while (done < expected)
+            std::this_thread::yield();
+    }
+};
+
+TEST_CASE("priority scheduling", "[threadpool]") {
+    BlockedPool blocked(GENERATE(kSchedulingShared, kSchedulingWorkStealing));
+    std::mutex order_lock;
+    std::vector<int> order;
+    std::atomic_int done(0);
+
+    auto task = [&](int id) {
+        return [&, id]() {
+            std::lock_guard<std::mutex> lock(order_lock);
+            order.push_back(id);
+            done++;
+        };
+    };
+
+    SECTION("lowest priority value first, FIFO within a priority") {
+        blocked.pool_.post(task(1), 5);
+        blocked.pool_.post(task(2), 1);
+        blocked.pool_.post(task(3), 5);
+        blocked.pool_.post(task(4), 0);
+
+        blocked.release_and_wait(done, 4);
+        REQUIRE(order == std::vector<int>{4, 2, 1, 3});
+    }
+
+    SECTION("reprioritise queued tagged tasks") {
+        blocked.pool_.post(task(1), 1, 100);
+        blocked.pool_.post(task(2), 2, 200);
+        blocked.pool_.post(task(3), 3); // untagged keeps its priority
+
+        blocked.pool_.reprioritise([](TaskTag tag, Priority old) {
+            return tag == 200 ? 0 : old + 10;
+        });
+
+        blocked.release_and_wait(done, 3);
+        REQUIRE(order == std::vector<int>{2, 3, 1});
+    }
+}
+
+TEST_CASE("cancellation", "[threadpool]") {
+    BlockedPool blocked(GENERATE(kSchedulingShared, kSchedulingWorkStealing));
+    std::atomic_int done(0);
+    std::atomic_bool ran_cancelled(false);
+
+    auto token = std::make_shared<CancellationToken>();
+    blocked.pool_.post([&]() { ran_cancelled = true; }, 0, kUntagged, token);
+    blocked.pool_.post([&]() { done++; }, 1);
+
+    REQUIRE(token->cancel());
+    REQUIRE(token->cancelled());
+
+    blocked.release_and_wait(done, 1);
+    REQUIRE_FALSE(ran_cancelled);
+
+    SECTION("too late once started") {
+        auto started = std::make_shared<CancellationToken>();
+        REQUIRE(started->begin());
+        REQUIRE_FALSE(started->cancel());
+        REQUIRE_FALSE(started->cancelled());
+    }
+}
+
+TEST_CASE("every task runs once", "[threadpool]") {
+    const SchedulingMode mode = GENERATE(kSchedulingShared, kSchedulingWorkStealing);
+    const int kPosters = 4, kTasksPerPoster = 5000;
+
+    ThreadPool pool(4, mode);
+    std::vector<std::atomic_int> runs(kPosters * kTasksPerPoster * 2);
+    std::atomic_int done(0);
+
+    std::vector<std::thread> posters;
+    for (int p = 0; p < kPosters; ++p) {
+        posters.emplace_back([&, p]() {
+            for (int i = 0; i < kTasksPerPoster; ++i) {
+                int id = (p * kTasksPerPoster + i) * 2;
+
+                // every other task posts a follow up from inside the pool
+                pool.post([&, id]() {
+                    runs[id]++;
+                    pool.post([&, id]() {
+                        runs[id + 1]++;
+                        done++;
+                    });
+                    done++;
+                }, i % 20);
+            }
+        });
+    }
+
+    for (auto &t : posters)
+        t.join();
+
+    while (done < static_cast<int>(runs.size()))
+        std::this_thread::yield();
+
+    REQUIRE(std::all_of(runs.begin(), runs.end(), [](const std::atomic_int &r) { return r == 1; }));
+}
@@ -1,5 +1,16 @@
 #include "catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "world/world.h"
+#include "world/chunk_load/range.h"
+#include "world/chunk_load/grid.h"
+#include "world/chunk_load/mpsc_queue.h"
+#include "world/chunk_load/render_list.h"
+#include "world/chunk_load/cache.h"
+#include "world/chunk_load/memory.h"
+#include "world/chunk_load/concurrent_pool.h"
 
 TEST_CASE("world things", "[world]") {
 
@@ -62,3 +73,559 @@ TEST_CASE("range check", "[world]") {
     REQUIRE(!World::is_in_loaded_range(0, 0, 5, -2, 10));
     REQUIRE(!World::is_in_loaded_range(0, 0, 5, 100, 0));
 }*/
+
+// every chunk in a but not b, the slow way
+static std::vector<ChunkId_t> brute_difference(const LoadRange &a, const LoadRange &b) {
+    std::vector<ChunkId_t> out;
+    for (int x = -50; x <= 50; ++x)
+        for (int z = -50; z <= 50; ++z)
+            if (a.contains(x, z) && !b.contains(x, z))
+                out.push_back(ChunkId(x, z));
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+TEST_CASE("load range difference", "[world]") {
+    const LoadRange from(0, 0, 5);
+    const LoadRange to = GENERATE(
+            LoadRange(0, 0, 5),   // unchanged
+            LoadRange(1, 0, 5),   // one step
+            LoadRange(-1, 2, 5),  // diagonal
+            LoadRange(30, -4, 5), // no overlap
+            LoadRange(0, 0, 7),   // grown
+            LoadRange(2, 1, 3),   // shrunk
+            LoadRange());         // empty
+
+    std::vector<ChunkId_t> entering, leaving;
+    to.difference(from, entering);
+    from.difference(to, leaving);
+    std::sort(entering.begin(), entering.end());
+    std::sort(leaving.begin(), leaving.end());
+
+    REQUIRE(entering == brute_difference(to, from));
+    REQUIRE(leaving == brute_difference(from, to));
+
+    if (to == from) {
+        REQUIRE(entering.empty());
+        REQUIRE(leaving.empty());
+    }
+}
+
+TEST_CASE("chunk grid", "[world]") {
+    ChunkGrid grid(2);
+    boost::unordered_map<ChunkId_t, ChunkState> expected;
+
+    // only compared, never dereferenced
+    auto fake_chunk = [](ChunkId_t c) { return reinterpret_cast<Chunk *>(c + 1); };
+
+    auto check = [&]() {
+        REQUIRE(grid.size() == expected.size());
+        for (auto &e : expected) {
+            Chunk *chunk;
+            REQUIRE(grid.get(e.first, &chunk) == e.second);
+            REQUIRE(chunk == fake_chunk(e.first));
+        }
+
+        size_t visited = 0;
+        grid.for_each([&](ChunkId_t c, Chunk *chunk, ChunkState state) {
+            REQUIRE(expected.at(c) == state);
+            visited++;
+        });
+        REQUIRE(visited == expected.size());
+    };
+
+    auto set = [&](int x, int z, ChunkState state) {
+        ChunkId_t c = ChunkId(x, z);
+        grid.set(c, fake_chunk(c), state);
+        if (state == ChunkState::kUnloaded)
+            expected.erase(c);
+        else
+            expected[c] = state;
+    };
+
+    SECTION("inside the window") {
+        set(0, 0, ChunkState::kRenderable);
+        set(-2, 1, ChunkState::kLoadingTerrain);
+        REQUIRE(grid.overflow_size() == 0);
+        check();
+
+        set(0, 0, ChunkState::kUnloaded);
+        REQUIRE(grid.get(ChunkId(0, 0)) == ChunkState::kUnloaded);
+        check();
+    }
+
+    SECTION("outside the window falls back") {
+        set(100, -100, ChunkState::kLoadedTerrain);
+        REQUIRE(grid.overflow_size() == 1);
+        check();
+    }
+
+    SECTION("moving and growing migrates chunks") {
+        int cx = 0, cz = 0, radius = 2;
+        for (int step = 0; step < 200; ++step) {
+            // wander, with the odd jump and resize
+            cx += step % 7 == 0 ? 3 : (step % 3) - 1;
+            cz += step % 5 == 0 ? -2 : 1;
+            if (step == 100) radius = 6;
+            if (step == 150) { cx += 40; cz -= 40; }
+            grid.recentre(cx, cz, radius);
+
+            for (int i = -radius; i <= radius; i += 2)
+                set(cx + i, cz - i, step % 2 ? ChunkState::kRenderable : ChunkState::kLoadingTerrain);
+            set(cx - radius, cz, ChunkState::kUnloaded);
+
+            check();
+        }
+    }
+}
+
+TEST_CASE("mpsc queue stress", "[world]") {
+    const int kProducers = 8, kPushes = 20000;
+
+    SECTION("nothing lost, FIFO per producer") {
+        MpscQueue<std::pair<int, int>> queue;
+        std::atomic_int producing(kProducers);
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < kProducers; ++p) {
+            producers.emplace_back([&, p]() {
+                for (int i = 0; i < kPushes; ++i)
+                    queue.push({p, i});
+                producing--;
+            });
+        }
+
+        // consume while they are still producing
+        std::vector<int> next(kProducers, 0);
+        std::vector<std::pair<int, int>> batch;
+        bool in_order = true;
+        while (true) {
+            bool finished = producing == 0;
+
+            batch.clear();
+            queue.drain(batch);
+            for (auto &e : batch)
+                in_order &= next[e.first]++ == e.second;
+
+            if (finished && queue.empty())
+                break;
+        }
+
+        for (auto &t : producers)
+            t.join();
+
+        REQUIRE(in_order);
+        REQUIRE(std::all_of(next.begin(), next.end(), [=](int n) { return n == kPushes; }));
+    }
+
+    SECTION("queued at most once") {
+        const int kIds = 64;
+        MpscQueue<int> queue;
+        std::vector<std::atomic_bool> queued(kIds);
+        std::vector<std::atomic_bool> wanted(kIds);
+        std::atomic_int producing(kProducers);
+
+        // producers want each id finalized, repeatedly
+        std::vector<std::thread> producers;
+        for (int p = 0; p < kProducers; ++p) {
+            producers.emplace_back([&, p]() {
+                for (int i = 0; i < kPushes; ++i) {
+                    int id = (i * 7 + p) % kIds;
+                    wanted[id] = true;
+                    queue.push_once(id, queued[id]);
+                }
+                producing--;
+            });
+        }
+
+        std::vector<int> batch;
+        bool duplicate = false;
+        while (true) {
+            bool finished = producing == 0;
+
+            batch.clear();
+            queue.drain(batch);
+            for (int id : batch) {
+                // as the loader does, only the consumer clears the flag
+                duplicate |= !queued[id].exchange(false);
+                wanted[id] = false;
+            }
+
+            if (finished && queue.empty())
+                break;
+        }
+
+        for (auto &t : producers)
+            t.join();
+
+        REQUIRE_FALSE(duplicate);
+
+        // every push was either queued or already covered by a queued entry
+        REQUIRE(std::none_of(wanted.begin(), wanted.end(), [](const std::atomic_bool &w) { return w.load(); }));
+    }
+}
+
+TEST_CASE("epoch reclamation", "[world]") {
+    const int kPublishes = 20000;
+
+    EpochReclaimer reclaimer;
+    std::vector<std::atomic_bool> freed(kPublishes + 1);
+    std::atomic_int current(0);
+    std::atomic_bool writing(true);
+    std::atomic_int frames(0);
+    bool still_alive = true;
+
+    std::thread reader([&]() {
+        while (writing) {
+            reclaimer.enter();
+            int held = current;
+
+            // give the writer a chance to publish and reclaim mid frame
+            std::this_thread::yield();
+            still_alive &= !freed[held];
+
+            reclaimer.exit();
+            frames++;
+        }
+    });
+
+    for (int i = 1; i <= kPublishes; ++i) {
+        // make sure frames interleave with publishing, even on one core
+        if (i % 1000 == 1) {
+            int seen = frames;
+            while (frames == seen)
+                std::this_thread::yield();
+        }
+
+        int old = current.exchange(i);
+        reclaimer.retire([&freed, old]() { freed[old] = true; });
+        reclaimer.reclaim();
+    }
+
+    writing = false;
+    reader.join();
+
+    REQUIRE(still_alive);
+
+    // nothing held back once the reader has gone
+    reclaimer.reclaim();
+    REQUIRE_FALSE(reclaimer.pending());
+    REQUIRE(std::count(freed.begin(), freed.end(), true) == kPublishes);
+}
+
+TEST_CASE("render list snapshots", "[world]") {
+    RenderList list;
+    ChunkMeshRaw vertices(6);
+    bool freed = false;
+
+    REQUIRE(list.begin_read().entries_.empty());
+    list.end_read();
+
+    list.publish({{nullptr, &vertices, vertices.size(), 1}});
+
+    // pinned by the reader
+    const RenderSnapshot &snapshot = list.begin_read();
+    REQUIRE(snapshot.entries_.size() == 1);
+    REQUIRE(snapshot.entries_[0].vertices_ == &vertices);
+    const uint64_t version = snapshot.version_;
+
+    list.publish({});
+    list.retire([&freed]() { freed = true; });
+    list.reclaim();
+    REQUIRE_FALSE(freed);
+    REQUIRE(snapshot.entries_.size() == 1);
+
+    // released
+    list.end_read();
+    list.reclaim();
+    REQUIRE(freed);
+    REQUIRE_FALSE(list.pending());
+
+    REQUIRE(list.begin_read().version_ > version);
+    list.end_read();
+}
+
+TEST_CASE("chunk cache", "[world]") {
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    for (int i = 0; i < 4; ++i)
+        chunks.emplace_back(new Chunk(ChunkId(i, 0), nullptr));
+
+    // room for 3 of 100 bytes
+    ChunkCache cache(300);
+    std::vector<Chunk *> evicted;
+
+    for (int i = 0; i < 3; ++i)
+        cache.put(chunks[i].get(), 100, evicted);
+    REQUIRE(evicted.empty());
+    REQUIRE(cache.bytes() == 300);
+
+    SECTION("hit and miss") {
+        REQUIRE(cache.take(ChunkId(1, 0)) == chunks[1].get());
+        REQUIRE(cache.take(ChunkId(1, 0)) == nullptr);
+        REQUIRE(cache.take(ChunkId(9, 9)) == nullptr);
+
+        ChunkCache::Stats stats = cache.stats();
+        REQUIRE(stats.hits_ == 1);
+        REQUIRE(stats.misses_ == 2);
+        REQUIRE(stats.count_ == 2);
+        REQUIRE(stats.bytes_ == 200);
+    }
+
+    SECTION("least recently used evicted first") {
+        // 0 is used again so 1 is now the oldest
+        cache.put(cache.take(ChunkId(0, 0)), 100, evicted);
+        cache.put(chunks[3].get(), 100, evicted);
+
+        REQUIRE(evicted == std::vector<Chunk *>{chunks[1].get()});
+        REQUIRE(cache.stats().evictions_ == 1);
+        REQUIRE(cache.bytes() == 300);
+    }
+
+    SECTION("stale copies are evicted") {
+        Chunk stale(ChunkId(1, 0), nullptr);
+        cache.put(&stale, 100, evicted);
+
+        REQUIRE(evicted == std::vector<Chunk *>{chunks[1].get()});
+        REQUIRE(cache.stats().evictions_ == 1);
+        REQUIRE(cache.size() == 3);
+    }
+
+    SECTION("bounded in bytes, not entries") {
+        cache.put(chunks[3].get(), 250, evicted);
+        REQUIRE(evicted == std::vector<Chunk *>{chunks[0].get(), chunks[1].get(), chunks[2].get()});
+        REQUIRE(cache.size() == 1);
+
+        // never fits
+        evicted.clear();
+        cache.set_budget(200, evicted);
+        REQUIRE(evicted == std::vector<Chunk *>{chunks[3].get()});
+        REQUIRE(cache.size() == 0);
+    }
+
+    SECTION("tickets only match while never taken out") {
+        ChunkId_t c = ChunkId(3, 0);
+        uint64_t first = cache.put(chunks[3].get(), 100, evicted);
+        REQUIRE(cache.holds(c, first));
+
+        // taken out and put back, e.g. re-entered the load range and left again
+        cache.put(cache.take(c), 100, evicted);
+        REQUIRE_FALSE(cache.holds(c, first));
+
+        // evicted
+        uint64_t second = cache.put(chunks[0].get(), 100, evicted);
+        REQUIRE(cache.holds(ChunkId(0, 0), second));
+        cache.set_budget(0, evicted);
+        REQUIRE_FALSE(cache.holds(ChunkId(0, 0), second));
+    }
+
+    SECTION("clear") {
+        cache.clear(evicted);
+        REQUIRE(evicted.size() == 3);
+        REQUIRE(cache.bytes() == 0);
+        REQUIRE(cache.stats().evictions_ == 0);
+    }
+}
+
+TEST_CASE("memory governor", "[world]") {
+    typedef MemoryGovernor::Clock Clock;
+    Clock::time_point now = Clock::now();
+    auto later = [&now]() { return now += MemoryGovernor::kRadiusStepInterval; };
+
+    // 1000 byte budget, low watermark of 750
+    MemoryGovernor memory(1000, 400);
+    size_t cache_budget;
+
+    memory.set(kMemoryChunks, 500);
+    memory.add(kMemoryMeshes, 100);
+    memory.add(kMemoryMeshes, -50);
+    memory.set(kMemoryCache, 100);
+    REQUIRE(memory.total() == 650);
+    REQUIRE(memory.govern(8, cache_budget, later()) == 8);
+    REQUIRE(cache_budget == 400);
+
+    SECTION("cache shrinks first") {
+        memory.add(kMemoryGpu, 400);
+        REQUIRE(memory.govern(8, cache_budget, later()) == 8);
+        REQUIRE(cache_budget == 50);
+    }
+
+    SECTION("then the radius, one step at a time") {
+        memory.add(kMemoryGpu, 600);
+        REQUIRE(memory.govern(8, cache_budget, later()) == 7);
+        REQUIRE(cache_budget == 0);
+
+        // too soon to step again
+        REQUIRE(memory.govern(8, cache_budget, now) == 7);
+        REQUIRE(memory.settling());
+
+        REQUIRE(memory.govern(8, cache_budget, later()) == 6);
+        REQUIRE(memory.stats().radius_limit_ == 6);
+
+        // held within the hysteresis band
+        memory.set(kMemoryGpu, 300);
+        REQUIRE(memory.govern(8, cache_budget, later()) == 6);
+
+        // the radius comes back before the cache
+        memory.set(kMemoryGpu, 0);
+        REQUIRE(memory.govern(8, cache_budget, later()) == 7);
+        REQUIRE(cache_budget == 0);
+        REQUIRE(memory.govern(8, cache_budget, later()) == 8);
+        REQUIRE(memory.stats().radius_limit_ == 0);
+
+        REQUIRE(memory.govern(8, cache_budget, later()) == 8);
+        REQUIRE(cache_budget == 100);
+
+        // and never beyond what is asked for
+        REQUIRE(memory.govern(4, cache_budget, later()) == 4);
+    }
+
+    SECTION("radius never below 1") {
+        memory.add(kMemoryGpu, 100000);
+        for (int i = 0; i < 10; ++i)
+            memory.govern(3, cache_budget, later());
+        REQUIRE(memory.govern(3, cache_budget, later()) == 1);
+        REQUIRE_FALSE(memory.settling());
+    }
+}
+
+TEST_CASE("world centre velocity", "[world]") {
+    struct Followee : ICentreOfTheGoddamnWorld {
+        glm::vec3 pos_{0, 0, 0};
+
+        void get_current_position(glm::vec3 &out) const override { out = pos_; }
+    } followee;
+
+    WorldCentre centre;
+    centre.follow(&followee);
+
+    WorldCentre::Clock::time_point now = WorldCentre::Clock::now();
+    auto frame = boost::chrono::milliseconds(16);
+
+    // a couple of seconds flying along x at full speed
+    for (int i = 0; i < 120; ++i) {
+        centre.tick(now);
+        now += frame;
+        followee.pos_.x += kCameraMoveSpeed * 0.016f;
+    }
+    centre.tick(now);
+
+    REQUIRE(centre.velocity().x == Approx(kCameraMoveSpeed).epsilon(0.01));
+    REQUIRE(centre.velocity().z == Approx(0));
+
+    ChunkId_t current = Chunk::owning_chunk(Block::from_world_pos(followee.pos_));
+    glm::vec3 ahead = followee.pos_ + glm::vec3(kCameraMoveSpeed, 0, 0);
+    REQUIRE(centre.projected_chunk(0) == current);
+    REQUIRE(centre.projected_chunk(1) == Chunk::owning_chunk(Block::from_world_pos(ahead)));
+
+    SECTION("teleports are not travel") {
+        followee.pos_.x += 100000;
+        now += frame;
+        centre.tick(now);
+        REQUIRE(centre.velocity().x == 0);
+    }
+
+    SECTION("settles when stopped") {
+        for (int i = 0; i < 120; ++i) {
+            now += frame;
+            centre.tick(now);
+        }
+        REQUIRE(centre.projected_chunk(2) == current);
+    }
+}
+
+TEST_CASE("concurrent object pool", "[world]") {
+    static std::atomic_int live;
+    struct Object {
+        int owner_;
+        uint64_t payload_[8];
+
+        explicit Object(int owner) : owner_(owner) { live++; }
+
+        ~Object() { live--; }
+    };
+    live = 0;
+
+    const int kThreads = 8;
+    const int kRounds = 2000;
+    ConcurrentObjectPool<Object> pool(16);
+
+    // each thread frees half its objects itself and hands the rest to the next thread
+    std::vector<MpscQueue<Object *>> handoff(kThreads);
+    std::atomic_int errors(0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<Object *> mine, received;
+            for (int round = 0; round < kRounds; ++round) {
+                for (int i = 0; i < 4; ++i) {
+                    Object *o = pool.new_object(t);
+                    std::fill(std::begin(o->payload_), std::end(o->payload_), (uint64_t) t);
+                    mine.push_back(o);
+                }
+
+                // no other thread may have been handed the same memory
+                for (Object *o : mine) {
+                    if (o->owner_ != t || o->payload_[7] != (uint64_t) t)
+                        errors++;
+                }
+
+                pool.delete_object(mine.back());
+                mine.pop_back();
+                pool.delete_object(mine.back());
+                mine.pop_back();
+                for (Object *o : mine)
+                    handoff[(t + 1) % kThreads].push(o);
+                mine.clear();
+
+                received.clear();
+                handoff[t].drain(received);
+                for (Object *o : received)
+                    pool.delete_object(o);
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    std::vector<Object *> left;
+    for (auto &queue : handoff)
+        queue.drain(left);
+    for (Object *o : left)
+        pool.delete_object(o);
+
+    REQUIRE(errors == 0);
+    REQUIRE(live == 0);
+
+    // reused rather than allocated each time
+    REQUIRE(pool.allocated() < (size_t) kThreads * kRounds);
+}
+
+TEST_CASE("recycling object pool", "[world]") {
+    struct Reset {
+        void operator()(std::vector<int> &v) const { v.clear(); }
+    };
+    ConcurrentObjectPool<std::vector<int>, Reset> pool(4);
+
+    // reused as it was freed, emptied but keeping its buffer
+    std::vector<int> *v = pool.new_object();
+    v->resize(1000);
+    const int *buffer = v->data();
+    pool.delete_object(v);
+
+    v = pool.new_object();
+    REQUIRE(v->empty());
+    REQUIRE(v->capacity() >= 1000);
+    REQUIRE(v->data() == buffer);
+
+    // spilled beyond a cache's worth in the central list are destroyed, not kept
+    std::vector<std::vector<int> *> many;
+    for (int i = 0; i < 64; ++i)
+        many.push_back(pool.new_object());
+    for (std::vector<int> *o : many)
+        pool.delete_object(o);
+    REQUIRE(pool.allocated() <= 4 + 4 + 1);
+
+    pool.delete_object(v);
+}
@@ -1,3 +1,4 @@
+#include <vector>
 #include <boost/algorithm/clamp.hpp>
 #include "FastNoise/FastNoise.h"
 #include "procgen.h"
@@ -12,19 +13,57 @@ int __attribute__((constructor)) init() {
     return 0;
 }
 
-int generate(int chunk_x, int chunk_z, int seed, ChunkTerrain &terrain_out) {
-    const double scale = 3.0;
+static const double kScale = 3.0;
+
+// top block of the column at world block coords
+static inline int column_height(int nx, int nz, int seed) {
+    double n = noise_.GetPerlin(nx / kScale, seed, nz / kScale) + 0.7;
+    return (int) boost::algorithm::clamp(n * kChunkHeight, 1, kChunkHeight - 1);
+}
 
+// heights[x * stride + z] is the top of column (x, z) of this chunk
+static void fill_chunk(const int *heights, size_t stride, ChunkTerrain &terrain_out) {
     for (unsigned int x = 0; x < kChunkWidth; x++) {
         for (unsigned int z = 0; z < kChunkDepth; z++) {
-            int nx = (chunk_x * kChunkWidth) + x;
-            int nz = (chunk_z * kChunkDepth) + z;
-            double n = noise_.GetPerlin(nx / scale, seed, nz / scale) + 0.7;
-
-            int top = (int) boost::algorithm::clamp(n * kChunkHeight, 1, kChunkHeight - 1);
-            for (unsigned int y = top; y > 0; y--) {
-                terrain_out[{x, y, z}] = static_cast<BlockType>((rand() % 3) + 1);
-            }
+            for (unsigned int y = heights[x * stride + z]; y > 0; y--)
+                terrain_out.set_type({x, y, z}, static_cast<BlockType>((rand() % 3) + 1));
+        }
+    }
+}
+
+int generate(int chunk_x, int chunk_z, int seed, ChunkTerrain &terrain_out) {
+    int heights[kChunkWidth * kChunkDepth];
+    for (unsigned int x = 0; x < kChunkWidth; x++) {
+        for (unsigned int z = 0; z < kChunkDepth; z++)
+            heights[x * kChunkDepth + z] = column_height(chunk_x * kChunkWidth + x, chunk_z * kChunkDepth + z, seed);
+    }
+
+    fill_chunk(heights, kChunkDepth, terrain_out);
+    return 0;
+}
+
+int generate_region(int chunk_x, int chunk_z, int n, int seed, ChunkTerrain **terrains_out) {
+    // the region's height field is sampled in one sweep of world rows, then sliced into each chunk in turn
+    const int width = n * kChunkWidth, depth = n * kChunkDepth;
+    thread_local std::vector<int> heights;
+    heights.resize(width * depth);
+
+    for (int wx = 0; wx < width; wx++) {
+        int i = wx / kChunkWidth;
+        for (int wz = 0; wz < depth; wz++) {
+            // nothing to fill in holes
+            if (terrains_out[i * n + wz / kChunkDepth] == nullptr)
+                continue;
+
+            heights[wx * depth + wz] = column_height(chunk_x * kChunkWidth + wx, chunk_z * kChunkDepth + wz, seed);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            ChunkTerrain *terrain = terrains_out[i * n + j];
+            if (terrain != nullptr)
+                fill_chunk(&heights[i * kChunkWidth * depth + j * kChunkDepth], depth, *terrain);
         }
     }
 
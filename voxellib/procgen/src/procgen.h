@@ -10,6 +10,12 @@ typedef int (*generate_t)(int, int, int, ChunkTerrain &);
 
 int generate(int chunk_x, int chunk_z, int seed, ChunkTerrain &terrain_out);
 
+// optional, generates an n*n region of chunks in one pass
+// terrains_out[i * n + j] is chunk (chunk_x + i, chunk_z + j), null entries are skipped
+typedef int (*generate_region_t)(int, int, int, int, ChunkTerrain **);
+
+int generate_region(int chunk_x, int chunk_z, int n, int seed, ChunkTerrain **terrains_out);
+
 }
 
 
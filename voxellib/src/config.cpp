@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/thread/thread_pool.hpp>
@@ -5,20 +6,23 @@
 #include "config.h"
 #include "world/generation/generator.h"
 #include "loguru/loguru.hpp"
+#include "util.h"
 
 namespace config {
     unsigned int kTerrainThreadWorkers, kInitialLoadedChunkRadius;
+    unsigned int kLoaderMaxTickRate = 60;
+    unsigned int kGenerationBatchSize = 1;
+    float kPrefetchSeconds = 2;
+    size_t kChunkCacheBytes, kMemoryBudgetBytes;
+    SchedulingMode kTerrainScheduling = kSchedulingShared;
+    MesherType kMesher = kMesherNaive;
+    std::string kStoragePath, kPackPath;
 
 
-    enum GeneratorType {
-        kFlat,
-        kPython,
-        kNoise,
-    };
     GeneratorType kGenType;
 
-    IGenerator *new_generator() {
-        switch (kGenType) {
+    static IGenerator *new_generator(GeneratorType type) {
+        switch (type) {
             case kNoise:
                 return new NativeGenerator;
             case kPython:
@@ -29,15 +33,37 @@ namespace config {
         }
     }
 
-    static void resolve_path(std::string &out) {
+    bool generator_type(const std::string &str, GeneratorType &out) {
+        if (str == "flat")
+            out = GeneratorType::kFlat;
+        else if (str == "noise")
+            out = GeneratorType::kNoise;
+        else if (str == "python")
+            out = GeneratorType::kPython;
+        else
+            return false;
+
+        return true;
+    }
+
+    IGenerator *new_generator() {
+        return new_generator(kGenType);
+    }
+
+    IGenerator *new_generator(const std::string &type) {
+        GeneratorType gen_type;
+        return generator_type(type, gen_type) ? new_generator(gen_type) : nullptr;
+    }
+
+    static void resolve_path(std::string &out, const char *relative_path = "config.xml") {
         char *env = std::getenv("VOXELS_PATH");
         out.append(env ? env : ".");
-        out.append("/config.xml");
+        out.append("/");
+        out.append(relative_path);
     }
 
-    template<typename T>
-    static T get(const boost::property_tree::ptree &tree, const std::string &key) {
-        // check env first
+    // terrain.threads -> VOX_TERRAIN_THREADS
+    static std::string env_key(const std::string &key) {
         const char *prefix = "VOX_";
         std::string env_key(prefix);
         env_key.append(key);
@@ -45,7 +71,13 @@ namespace config {
         for (auto &c : env_key)
             c = std::toupper(c == '.' ? '_' : c);
 
-        char *env_value = std::getenv(env_key.c_str());
+        return env_key;
+    }
+
+    template<typename T>
+    static T get(const boost::property_tree::ptree &tree, const std::string &key) {
+        // check env first
+        char *env_value = std::getenv(env_key(key).c_str());
         if (env_value)
             return boost::lexical_cast<T>(env_value);
 
@@ -53,6 +85,16 @@ namespace config {
         return tree.get<T>(key);
     }
 
+    // as above, but defaults to fallback if missing from both
+    template<typename T>
+    static T get(const boost::property_tree::ptree &tree, const std::string &key, const T &fallback) {
+        char *env_value = std::getenv(env_key(key).c_str());
+        if (env_value)
+            return boost::lexical_cast<T>(env_value);
+
+        return tree.get<T>(key, fallback);
+    }
+
     static int thread_count(const boost::property_tree::ptree &tree, const char *key) {
         unsigned int count = get<int>(tree, key);
         if (count <= 0)
@@ -67,15 +109,69 @@ namespace config {
     static GeneratorType generator(const boost::property_tree::ptree &tree, std::string &out) {
         std::string str = get<std::string>(tree, "terrain.generator");
         GeneratorType type;
+        if (!generator_type(str, type))
+            throw std::runtime_error("terrain.generator should be one of flat,noise,python");
 
-        if (str == "flat")
-            type = GeneratorType::kFlat;
-        else if (str == "noise")
-            type = GeneratorType::kNoise;
-        else if (str == "python")
-            type = GeneratorType::kPython;
+        out = str;
+        return type;
+    }
+
+    // relative to VOXELS_PATH unless absolute
+    static std::string storage_path(const boost::property_tree::ptree &tree, const char *key) {
+        std::string str = get<std::string>(tree, key, "");
+        if (str.empty() || str[0] == '/')
+            return str;
+
+        std::string path;
+        resolve_path(path, str.c_str());
+        return path;
+    }
+
+    static size_t cache_bytes(const boost::property_tree::ptree &tree) {
+        const size_t mb = 1024 * 1024;
+        size_t bytes = get<size_t>(tree, "terrain.cache_mb", 0) * mb;
+        if (bytes > 0)
+            return bytes;
+
+        // an eighth of what is available, within reason
+        bytes = available_memory_bytes() / 8;
+        return std::min(std::max(bytes, 32 * mb), 2048 * mb);
+    }
+
+    static size_t memory_budget_bytes(const boost::property_tree::ptree &tree) {
+        const size_t mb = 1024 * 1024;
+        size_t bytes = get<size_t>(tree, "terrain.memory_mb", 0) * mb;
+        if (bytes > 0)
+            return bytes;
+
+        return std::max(available_memory_bytes() / 2, 256 * mb);
+    }
+
+    static SchedulingMode scheduling(const boost::property_tree::ptree &tree, std::string &out) {
+        std::string str = get<std::string>(tree, "terrain.scheduling", "shared");
+        SchedulingMode mode;
+
+        if (str == "shared")
+            mode = kSchedulingShared;
+        else if (str == "stealing")
+            mode = kSchedulingWorkStealing;
         else
-            throw std::runtime_error("terrain.generator should be one of flat,noise,python");
+            throw std::runtime_error("terrain.scheduling should be one of shared,stealing");
+
+        out = str;
+        return mode;
+    }
+
+    static MesherType mesher(const boost::property_tree::ptree &tree, std::string &out) {
+        std::string str = get<std::string>(tree, "render.mesher", "naive");
+        MesherType type;
+
+        if (str == "naive")
+            type = MesherType::kMesherNaive;
+        else if (str == "greedy")
+            type = MesherType::kMesherGreedy;
+        else
+            throw std::runtime_error("render.mesher should be one of naive,greedy");
 
         out = str;
         return type;
@@ -93,15 +189,49 @@ namespace config {
         kTerrainThreadWorkers = thread_count(tree, "terrain.threads");
         LOG_F(INFO, "config: terrain.threads == %d", kTerrainThreadWorkers);
 
-        // generator
         std::string str;
+        kTerrainScheduling = scheduling(tree, str);
+        LOG_F(INFO, "config: terrain.scheduling == %s", str.c_str());
+
+        // generator
         kGenType = generator(tree, str);
         LOG_F(INFO, "config: terrain.generator == %s", str.c_str());
 
+        kGenerationBatchSize = get<unsigned int>(tree, "terrain.batch_size", 1);
+        if (kGenerationBatchSize < 1) kGenerationBatchSize = 1;
+        LOG_F(INFO, "config: terrain.batch_size == %d", kGenerationBatchSize);
+
         // chunk radius
         kInitialLoadedChunkRadius = get<int>(tree, "terrain.load_radius");
         if (kInitialLoadedChunkRadius < 1) kInitialLoadedChunkRadius = 1;
         LOG_F(INFO, "config: terrain.load_radius == %d", kInitialLoadedChunkRadius);
+
+        // chunk cache
+        kChunkCacheBytes = cache_bytes(tree);
+        LOG_F(INFO, "config: terrain.cache_mb == %zu", kChunkCacheBytes / (1024 * 1024));
+
+        // memory budget
+        kMemoryBudgetBytes = memory_budget_bytes(tree);
+        LOG_F(INFO, "config: terrain.memory_mb == %zu", kMemoryBudgetBytes / (1024 * 1024));
+
+        // prefetching
+        kPrefetchSeconds = std::max(get<float>(tree, "terrain.prefetch_seconds", 2), 0.f);
+        LOG_F(INFO, "config: terrain.prefetch_seconds == %.2f", kPrefetchSeconds);
+
+        // loader tick rate
+        kLoaderMaxTickRate = get<unsigned int>(tree, "terrain.max_tick_rate", 60);
+        LOG_F(INFO, "config: terrain.max_tick_rate == %d", kLoaderMaxTickRate);
+
+        // mesher
+        kMesher = mesher(tree, str);
+        LOG_F(INFO, "config: render.mesher == %s", str.c_str());
+
+        // storage
+        kStoragePath = storage_path(tree, "storage.path");
+        LOG_F(INFO, "config: storage.path == %s", kStoragePath.empty() ? "(none)" : kStoragePath.c_str());
+
+        kPackPath = storage_path(tree, "storage.pack");
+        LOG_F(INFO, "config: storage.pack == %s", kPackPath.empty() ? "(none)" : kPackPath.c_str());
     }
 
 }
@@ -1,25 +1,93 @@
 #ifndef VOXELS_CONFIG_H
 #define VOXELS_CONFIG_H
 
+#include <cstddef>
 #include <string>
+#include "threadpool.h"
 
 class IGenerator;
 
 // loaded once on startup and never updated
 namespace config {
 
+    // stored in world packs, so never renumbered
+    enum GeneratorType {
+        kFlat,
+        kPython,
+        kNoise,
+    };
+
     // type of terrain generation
     // terrain.generator
+    extern GeneratorType kGenType;
+
     IGenerator *new_generator();
 
+    // false if type is not one of flat|noise|python
+    bool generator_type(const std::string &type, GeneratorType &out);
+
+    // null if type is not one of flat|noise|python
+    IGenerator *new_generator(const std::string &type);
+
     // number of worker threads for terrain generation
     // terrain.threads
     // defaults to hardware limit if 0/not present
     extern unsigned int kTerrainThreadWorkers;
 
+    // how terrain workers share out tasks
+    // terrain.scheduling
+    // shared|stealing, defaults to shared if not present, stealing only keeps priority order per worker
+    extern SchedulingMode kTerrainScheduling;
+
+    // chunks are generated together in regions of this many chunks square
+    // terrain.batch_size
+    // 1 for a task per chunk, defaults to 1 if 0/not present
+    extern unsigned int kGenerationBatchSize;
+
     // radius of chunks around player to load
     extern unsigned int kInitialLoadedChunkRadius;
 
+    // byte budget of the cache of chunks that have left the load range
+    // terrain.cache_mb
+    // defaults to an eighth of available memory if 0/not present
+    extern size_t kChunkCacheBytes;
+
+    // overall byte budget of chunks, meshes, the cache and gpu buffers, enforced by shrinking the cache
+    // and then the loaded radius
+    // terrain.memory_mb
+    // defaults to half of available memory if 0/not present
+    extern size_t kMemoryBudgetBytes;
+
+    // how far ahead of the moving centre to generate chunks at low priority into the cache
+    // terrain.prefetch_seconds
+    // 0 to disable, defaults to 2 if not present
+    extern float kPrefetchSeconds;
+
+    // upper limit on loader ticks per second, it only ticks at all when there is work to do
+    // terrain.max_tick_rate
+    // 0 for no limit, defaults to 60 if not present
+    extern unsigned int kLoaderMaxTickRate;
+
+    // directory of region files that generated chunks are saved to and loaded from
+    // storage.path
+    // relative to VOXELS_PATH, chunks are not saved if empty/not present
+    extern std::string kStoragePath;
+
+    // read only pack of pre-baked chunks, served before anything saved or generated
+    // storage.pack
+    // relative to VOXELS_PATH, no pack if empty/not present
+    extern std::string kPackPath;
+
+    enum MesherType {
+        kMesherNaive,
+        kMesherGreedy,
+    };
+
+    // chunk mesh generation
+    // render.mesher
+    // naive|greedy, defaults to naive if not present, greedy trades meshing time for fewer vertices
+    extern MesherType kMesher;
+
 
     // loads from config.json
     // to be called once only
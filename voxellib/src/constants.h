@@ -22,20 +22,26 @@ const int kChunkDepth = 1 << kChunkDepthShift;
 
 const int kBlocksPerChunk = kChunkWidth * kChunkHeight * kChunkDepth;
 
+// terrain generation seed, until there is more than one world
+const int kWorldSeed = 50;
+
 
 // as defined in kBlockVertices, 3 for pos
 const int kFloatsPerVertex = 3;
 
 /**
- * vec3f (pos) + vec4b (colour)
+ * pos + face + block type packed into one word, see world/vertex.h
  */
-const int kChunkMeshWordsPerVertexInstance = 3 + 1 /*+ 1*/;
+const int kChunkMeshWordsPerVertexInstance = 1;
 
 /**
  * 12 triangles
  */
 const int kChunkMeshVerticesPerBlock = 12 * 3;
 
-const int kChunkMeshSize = kBlocksPerChunk * kChunkMeshWordsPerVertexInstance * kChunkMeshWordsPerVertexInstance;
+/**
+ * Worst case, every face of every block visible
+ */
+const int kChunkMeshSize = kBlocksPerChunk * kChunkMeshVerticesPerBlock * kChunkMeshWordsPerVertexInstance;
 
 #endif
@@ -8,6 +8,7 @@ enum VoxelError {
     kErrorShaderLoad,
     kErrorIo,
     kErrorDl,
+    kErrorFormat,
 };
 
 #endif
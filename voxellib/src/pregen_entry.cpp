@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "pregen_entry.h"
+#include "config.h"
+#include "error.h"
+#include "util.h"
+#include "world/generation/generator.h"
+#include "world/storage/pregen.h"
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options] <min x> <min z> <max x> <max z>\n"
+            "generates and saves every chunk in the inclusive rectangle, skipping those already saved\n"
+            "\n"
+            "  --seed <n>          defaults to the game's seed, %d\n"
+            "  --generator <type>  flat|noise|python, defaults to terrain.generator\n"
+            "  --threads <n>       defaults to terrain.threads\n"
+            "  --batch <n>         chunks square per task, defaults to terrain.batch_size\n"
+            "  --out <dir>         defaults to storage.path\n"
+            "  --pack <file>       then also writes the rectangle to a read only world pack, see storage.pack\n",
+            program, kWorldSeed);
+}
+
+static bool parse_int(const char *str, int &out) {
+    char *end;
+    long val = strtol(str, &end, 10);
+    if (*str == '\0' || *end != '\0')
+        return false;
+
+    out = static_cast<int>(val);
+    return true;
+}
+
+int run_pregen(int argc, char **argv) {
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+    config::load();
+
+    PregenOptions options{};
+    options.seed_ = kWorldSeed;
+    options.generator_ = config::kGenType;
+    options.directory_ = config::kStoragePath;
+    options.threads_ = config::kTerrainThreadWorkers;
+    options.batch_size_ = config::kGenerationBatchSize;
+    std::string generator, pack;
+
+    int rect[4], rect_args = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        int n;
+
+        if (strncmp(arg, "--", 2) != 0) {
+            if (rect_args == 4 || !parse_int(arg, rect[rect_args++])) {
+                usage(argv[0]);
+                return 1;
+            }
+            continue;
+        }
+
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+
+        if (strcmp(arg, "--seed") == 0 && parse_int(value, n)) {
+            options.seed_ = n;
+        } else if (strcmp(arg, "--generator") == 0) {
+            generator = value;
+        } else if (strcmp(arg, "--threads") == 0 && parse_int(value, n) && n > 0) {
+            options.threads_ = n;
+        } else if (strcmp(arg, "--batch") == 0 && parse_int(value, n) && n > 0) {
+            options.batch_size_ = n;
+        } else if (strcmp(arg, "--out") == 0) {
+            options.directory_ = value;
+        } else if (strcmp(arg, "--pack") == 0) {
+            pack = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (rect_args != 4 || options.directory_.empty()) {
+        if (options.directory_.empty())
+            fprintf(stderr, "no output directory, pass --out or set storage.path\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    options.min_x_ = std::min(rect[0], rect[2]);
+    options.min_z_ = std::min(rect[1], rect[3]);
+    options.max_x_ = std::max(rect[0], rect[2]);
+    options.max_z_ = std::max(rect[1], rect[3]);
+
+    // checked up front, the factory is only called from workers
+    if (!generator.empty()) {
+        config::GeneratorType type;
+        if (!config::generator_type(generator, type)) {
+            usage(argv[0]);
+            return 1;
+        }
+        options.generator_ = type;
+    }
+
+    auto new_generator = [&generator]() {
+        return generator.empty() ? config::new_generator() : config::new_generator(generator);
+    };
+
+    auto report = [](const PregenProgress &p) {
+        size_t done = p.skipped_ + p.generated_ + p.failed_;
+        printf("%zu/%zu chunks (%.1f%%), %zu generated, %zu already saved, %zu failed, %.0f chunks/s\n",
+               done, p.total_, p.total_ > 0 ? done * 100.0 / p.total_ : 100.0, p.generated_, p.skipped_,
+               p.failed_, p.chunks_per_second());
+        fflush(stdout);
+    };
+
+    printf("generating chunks (%d, %d) to (%d, %d) with seed %d on %u threads into %s\n",
+           options.min_x_, options.min_z_, options.max_x_, options.max_z_, options.seed_, options.threads_,
+           options.directory_.c_str());
+
+    PregenProgress progress;
+    int ret = pregenerate(options, new_generator, progress, report);
+
+    printf("done in %.1fs\n", progress.seconds_);
+    if (ret != kErrorSuccess)
+        return 2;
+
+    if (!pack.empty()) {
+        size_t packed;
+        if (pack_stored(options, pack, packed) != kErrorSuccess) {
+            fprintf(stderr, "failed to write world pack %s\n", pack.c_str());
+            return 2;
+        }
+        printf("packed %zu chunks into %s\n", packed, pack.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef VOXELS_PREGEN_ENTRY_H
+#define VOXELS_PREGEN_ENTRY_H
+
+// headless, generates and saves a rectangle of chunks, see usage
+int run_pregen(int argc, char **argv);
+
+#endif
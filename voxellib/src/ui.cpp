@@ -31,6 +31,7 @@ void Ui::init(SDL_Window *window, const char *glsl_version, SDL_GLContext *gl_co
     chunk_str_.reserve(64);
     dir_str_.reserve(64);
     chunk_rad_str_.resize(64, '\0');
+    memory_str_.resize(64, '\0');
 }
 
 void Ui::do_frame(const Camera &camera, const World &world) {
@@ -128,6 +129,36 @@ void Ui::make_ui(const Camera &camera, const World &world) {
         ImGui::TextUnformatted(str);
     }
 
+    // memory use
+    {
+        const double mb = 1024.0 * 1024.0;
+        MemoryGovernor::Stats stats = world.memory_stats();
+        char *str = memory_str_.data();
+
+        snprintf(str, 64, "Memory: %.1f/%.0f MB", stats.total_ / mb, stats.budget_ / mb);
+        ImGui::TextUnformatted(str);
+
+        for (int i = 0; i < kMemoryCategoryCount; ++i) {
+            MemoryCategory category = static_cast<MemoryCategory>(i);
+            snprintf(str, 64, "  %-7s %8.1f MB", memory_category_str(category), stats.used_[i] / mb);
+            ImGui::TextUnformatted(str);
+        }
+
+        snprintf(str, 64, "Cache budget: %.1f MB", stats.cache_budget_ / mb);
+        ImGui::TextUnformatted(str);
+
+        ChunkCache::Stats cache = world.cache_stats();
+        uint64_t lookups = cache.hits_ + cache.misses_;
+        snprintf(str, 64, "  %zu chunks, %.0f%% hits, %llu evicted", cache.count_,
+                 lookups > 0 ? cache.hits_ * 100.0 / lookups : 0.0, (unsigned long long) cache.evictions_);
+        ImGui::TextUnformatted(str);
+
+        if (stats.radius_limit_ > 0) {
+            snprintf(str, 64, "Radius limited to %d", stats.radius_limit_);
+            ImGui::TextUnformatted(str);
+        }
+    }
+
     ImGui::End();
 }
 
@@ -27,6 +27,7 @@ private:
     std::string dir_str_;
     std::string chunk_str_;
     std::vector<char> chunk_rad_str_; // poor man's string
+    std::vector<char> memory_str_;
 };
 
 
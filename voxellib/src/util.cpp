@@ -1,5 +1,7 @@
 #include <cstdarg>
+#include <cstdio>
 #include <iostream>
+#include <unistd.h>
 #include "util.h"
 
 void resolve_resource_path(std::string &out, const char *relative_path) {
@@ -14,3 +16,27 @@ void resolve_resource_path(std::string &out, const char *relative_path) {
     out.append("voxellib/res/");
     out.append(relative_path);
 }
+
+size_t available_memory_bytes() {
+    // counts reclaimable page cache too, unlike free pages which a warm page cache shrinks to nothing
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    if (meminfo != nullptr) {
+        char line[128];
+        unsigned long long kb;
+        bool found = false;
+        while (!found && fgets(line, sizeof(line), meminfo) != nullptr)
+            found = sscanf(line, "MemAvailable: %llu kB", &kb) == 1;
+        fclose(meminfo);
+
+        if (found)
+            return static_cast<size_t>(kb) * 1024;
+    }
+
+    // no MemAvailable before linux 3.14, nor off linux
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0)
+        return 0;
+
+    return static_cast<size_t>(pages) * static_cast<size_t>(page_size);
+}
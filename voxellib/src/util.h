@@ -1,6 +1,7 @@
 #ifndef VOXELS_UTIL_H
 #define VOXELS_UTIL_H
 
+#include <cstddef>
 #include <string>
 #include "loguru/loguru.hpp" // to avoid including in every damn file manually
 
@@ -12,4 +13,15 @@
  */
 void resolve_resource_path(std::string &out, const char *relative_path);
 
+/**
+ * @return Physical memory available to the process without swapping, including reclaimable page cache,
+ * or 0 if unknown
+ */
+size_t available_memory_bytes();
+
+// rounds towards negative infinity, so regions tile the negative quadrants too
+inline int floor_to_multiple(int x, int n) {
+    return (x >= 0 ? x / n : (x - n + 1) / n) * n;
+}
+
 #endif
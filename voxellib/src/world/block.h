@@ -19,10 +19,13 @@ const static long kBlockTypeColours[] = {
         0xffff0d00, // kMarker
 };
 
+const int kBlockTypeCount = sizeof(kBlockTypeColours) / sizeof(kBlockTypeColours[0]);
+
 inline bool BlockType_opaque(BlockType bt) {
     return bt != BlockType::kAir;
 }
 
+// 1 byte type + 1 byte face mask
 struct Block {
     BlockType type_;
     FaceVisibility face_visibility_;
@@ -38,4 +41,6 @@ struct Block {
     }
 };
 
+static_assert(sizeof(Block) == 2, "Block should be packed into 2 bytes");
+
 #endif
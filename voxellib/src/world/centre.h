@@ -1,6 +1,7 @@
 #ifndef VOXELS_CENTRE_H
 #define VOXELS_CENTRE_H
 
+#include <boost/chrono.hpp>
 #include "glm/vec3.hpp"
 #include "chunk.h"
 
@@ -11,8 +12,12 @@ public:
 
 class WorldCentre {
 public:
+    typedef boost::chrono::steady_clock Clock;
 
-    inline void follow(ICentreOfTheGoddamnWorld *followee) { followee_ = followee; }
+    inline void follow(ICentreOfTheGoddamnWorld *followee) {
+        followee_ = followee;
+        has_pos_ = false;
+    }
 
     inline void stop_following() { followee_ = nullptr; }
 
@@ -20,15 +25,26 @@ public:
 
     inline ChunkId_t chunk() const { return last_chunk_; };
 
-    inline void tick() { if (followee_ != nullptr) followee_->get_current_position(pos_); }
+    // samples the followee's position, and its velocity since the last tick
+    void tick(Clock::time_point now = Clock::now());
 
     inline void reset() { last_chunk_ = kChunkIdInit; }
 
+    // smoothed, in world units per second
+    inline const glm::vec3 &velocity() const { return velocity_; }
+
+    // chunk the centre will be in after this long if it keeps moving the same way
+    ChunkId_t projected_chunk(float seconds) const;
+
 private:
     ICentreOfTheGoddamnWorld *followee_ = nullptr;
 
     glm::vec3 pos_;
 
+    glm::vec3 velocity_{0, 0, 0};
+    Clock::time_point last_tick_;
+    bool has_pos_ = false;
+
     /**
      * id of the chunk the centre was in last tick
      */
@@ -1,10 +1,12 @@
-#include <GL/glew.h>
+#include <cmath>
 #include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
 #include "chunk.h"
-#include "world_renderer.h"
 #include "face.h"
 #include "util.h"
 #include "centre.h"
+#include "mesher.h"
+#include "config.h"
 
 
 Chunk::Chunk(ChunkId_t id, ChunkMeshRaw *mesh) : id_(id), mesh_(mesh, id) {
@@ -16,65 +18,27 @@ bool Chunk::loaded() const {
     return /*terrain_.size() > 0 && */mesh_.has_mesh();
 }
 
-ChunkMeshRaw *Chunk::populate_mesh(ChunkMeshRaw *alternate) {
-    ChunkMeshRaw &mesh = alternate == nullptr ? mesh_.mesh() : *alternate;
-
-    ChunkTerrain::BlockCoord block_pos;
-    size_t out_idx = 0;
-
-    for (int block_idx = 0; block_idx < kBlocksPerChunk; ++block_idx) {
-        const Block &block = terrain_[block_idx];
-        // cull if totally occluded
-        if (block.face_visibility_.invisible())
-            continue;
-
-        // cull air blocks
-        if (block.type_ == BlockType::kAir)
-            continue;
-
-        terrain_.expand(block_idx, block_pos);
-
-        for (int face_idx = 0; face_idx < kFaceCount; ++face_idx) {
-            auto face = kFaces[face_idx];
-
-            // cull face if not visible
-            if (!block.face_visibility_.visible(face))
-                continue;
-
-            int stride = 6 * 3; // 6 vertices * 6 floats per face
-            const float *verts = kBlockVertices + (stride * (int) face);
-
-            union {
-                float f;
-                int i;
-            } f_or_i;
-
-            for (int v = 0; v < 6; ++v) {
-                // vertex pos in chunk space
-                int v_idx = v * 3;
-                for (int j = 0; j < 3; ++j) {
-                    f_or_i.f = verts[v_idx + j] + block_pos[j] * 2 * kBlockRadius;
-                    mesh[out_idx++] = f_or_i.i;
-                }
-                // colour
-                int colour = kBlockTypeColours[static_cast<int>(block.type_)];
-                mesh[out_idx++] = colour;
-                assert(out_idx < kChunkMeshSize);
-/*
-                // ao
-                char ao_idx = ao_get_vertex(block.ao, face, v);
-                float ao = AO_CURVE[ao_idx];
-                f_or_i.f = ao;
-                buffer[out_idx++] = f_or_i.i;*/
-            }
-        }
+size_t Chunk::build_mesh(const ChunkTerrain &terrain, ChunkMeshRaw &mesh_out, size_t size_hint) {
+    // remeshes are usually about the same size as the last mesh
+    mesh_out.clear();
+    mesh_out.reserve(size_hint);
+
+    size_t out_idx;
+    switch (config::kMesher) {
+        case config::kMesherGreedy:
+            out_idx = mesh_greedy(terrain, mesh_out);
+            break;
+        case config::kMesherNaive:
+        default:
+            out_idx = mesh_naive(terrain, mesh_out);
+            break;
     }
 
-    DLOG_F(INFO, "%s: new mesh is size %lu/%d", CHUNKSTR(this), out_idx, kChunkMeshSize);
+    // don't hold on to growth slack for the lifetime of the chunk
+    if (mesh_out.capacity() > out_idx + out_idx / 4)
+        mesh_out.shrink_to_fit();
 
-    // set size and swap out
-    ChunkMeshRaw *old_mesh = mesh_.on_mesh_update(out_idx, alternate);
-    return old_mesh;
+    return out_idx;
 }
 
 ChunkId_t Chunk::owning_chunk(const glm::ivec3 &block_pos) {
@@ -85,7 +49,7 @@ ChunkId_t Chunk::owning_chunk(const glm::ivec3 &block_pos) {
 }
 
 void Chunk::post_terrain_update() {
-    // TODO dont do this if loaded from file and already populated
+    // chunks restored from disk already have these, see ChunkRecord
     terrain_.update_face_visibility();
     terrain_.populate_neighbour_opacity();
 }
@@ -100,6 +64,27 @@ bool Chunk::merge_faces_with_neighbour(Chunk *neighbour_chunk, ChunkNeighbour si
     return should_merge;
 }
 
+void Chunk::merge_region(Chunk **chunks, int n) {
+    auto at = [chunks, n](int i, int j) -> Chunk * {
+        return i >= 0 && i < n && j >= 0 && j < n ? chunks[i * n + j] : nullptr;
+    };
+
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            Chunk *chunk = at(i, j);
+            if (chunk == nullptr)
+                continue;
+
+            // same order as neighbours()
+            Chunk *neighbours[ChunkNeighbour::kCount] = {at(i - 1, j), at(i, j - 1), at(i, j + 1), at(i + 1, j)};
+            for (int side = 0; side < ChunkNeighbour::kCount; ++side) {
+                if (neighbours[side] != nullptr)
+                    chunk->merge_faces_with_neighbour(neighbours[side], side);
+            }
+        }
+    }
+}
+
 void Chunk::neighbours(ChunkNeighbours &out) const {
     int x, z;
     ChunkId_deconstruct(id_, x, z);
@@ -114,6 +99,9 @@ void Chunk::neighbours(ChunkNeighbours &out) const {
 
 void Chunk::reset_for_cache() {
     terrain_.reset_merged_faces();
+
+    // any entry still queued is dropped by the loader as the chunk is no longer loaded
+    finalization_queued_ = false;
 }
 
 void Chunk::mark_load_time_now() {
@@ -125,6 +113,45 @@ bool Chunk::was_loaded_before(boost::posix_time::ptime barrier) const {
 }
 
 
+// movements faster than this are teleports rather than travel
+static const float kMaxTrackedSpeed = kCameraMoveSpeed * 10;
+
+// seconds for the velocity estimate to mostly catch up with a change in movement
+static const float kVelocitySmoothing = 0.25f;
+
+void WorldCentre::tick(Clock::time_point now) {
+    if (followee_ == nullptr)
+        return;
+
+    glm::vec3 last_pos = pos_;
+    followee_->get_current_position(pos_);
+
+    float dt = boost::chrono::duration<float>(now - last_tick_).count();
+    last_tick_ = now;
+
+    if (!has_pos_) {
+        has_pos_ = true;
+        velocity_ = glm::vec3(0);
+        return;
+    }
+
+    if (dt <= 0)
+        return;
+
+    glm::vec3 instant = (pos_ - last_pos) / dt;
+    if (glm::length(instant) > kMaxTrackedSpeed) {
+        velocity_ = glm::vec3(0);
+        return;
+    }
+
+    float alpha = 1.f - std::exp(-dt / kVelocitySmoothing);
+    velocity_ += (instant - velocity_) * alpha;
+}
+
+ChunkId_t WorldCentre::projected_chunk(float seconds) const {
+    return Chunk::owning_chunk(Block::from_world_pos(pos_ + velocity_ * seconds));
+}
+
 bool WorldCentre::chunk(ChunkId_t &chunk_out) {
     auto current_chunk = Chunk::owning_chunk(Block::from_world_pos(pos_));
     bool changed = current_chunk != last_chunk_;
@@ -135,7 +162,7 @@ bool WorldCentre::chunk(ChunkId_t &chunk_out) {
     return changed;
 }
 
-ChunkMesh::ChunkMesh(ChunkMeshRaw *mesh, ChunkId_t chunk_id) : mesh_(mesh), dirty_(true) {
+ChunkMesh::ChunkMesh(ChunkMeshRaw *mesh, ChunkId_t chunk_id) : mesh_(mesh) {
     ChunkId_deconstruct(chunk_id, x_, z_);
 }
 
@@ -146,29 +173,20 @@ ChunkMeshRaw *ChunkMesh::steal_mesh() {
     return tmp;
 }
 
-bool ChunkMesh::prepare_render() {
-    if (mesh_ == nullptr) {
-        LOG_F(WARNING, "mesh for %d, %d is missing, skipping", x_, z_);
-        return false;
-    }
-
-    if (vao_ == 0 || vbo_ == 0) {
-        glGenBuffers(1, &vbo_);
-        glGenVertexArrays(1, &vao_);
-    }
-
-    if (dirty_) {
-        dirty_ = false;
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-        glBufferData(GL_ARRAY_BUFFER, mesh_size_ * sizeof(int), mesh_, GL_STATIC_DRAW);
-    }
+size_t ChunkMesh::release_gpu(unsigned int &vao_out, unsigned int &vbo_out) {
+    vao_out = vao_;
+    vbo_out = vbo_;
+    size_t bytes = gpu_bytes_;
 
-    return true;
+    vao_ = vbo_ = 0;
+    uploaded_version_ = 0;
+    gpu_bytes_ = 0;
+    return bytes;
 }
 
 ChunkMeshRaw *ChunkMesh::on_mesh_update(size_t new_size, ChunkMeshRaw *new_mesh) {
     mesh_size_ = new_size;
-    dirty_ = true;
+    version_++;
     if (new_mesh != nullptr) {
         ChunkMeshRaw *old = mesh_;
         mesh_ = new_mesh;
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <array>
+#include <vector>
 #include <boost/thread/shared_mutex.hpp>
 #include "glm/vec3.hpp"
 #include <atomic>
@@ -12,6 +13,7 @@
 #include "constants.h"
 #include "chunk_load/state.h"
 #include "terrain.h"
+#include "vertex.h"
 
 
 typedef uint64_t ChunkId_t;
@@ -42,7 +44,8 @@ inline unsigned int loaded_radius_chunk_count(int radius) {
     return (2 * radius + 1) * (2 * radius + 1);
 }
 
-typedef std::array<int32_t, kChunkMeshSize> ChunkMeshRaw;
+// grows to fit, kChunkMeshSize is only the theoretical worst case
+typedef std::vector<PackedVertex> ChunkMeshRaw;
 
 class ChunkMesh {
 
@@ -59,9 +62,24 @@ public:
 
     inline ChunkMeshRaw &mesh() { return *mesh_; }
 
-    // must be run in main thread
-    // returns if successful
-    bool prepare_render();
+    // bumped each mesh update
+    inline uint64_t version() const { return version_; }
+
+    /**
+     * Must be run in main thread, uploads the vertices if version has changed since last time
+     * @return Change in bytes uploaded to the gpu
+     */
+    int64_t prepare_render(const ChunkMeshRaw &vertices, size_t size, uint64_t version);
+
+    // bytes last uploaded by prepare_render
+    inline size_t gpu_bytes() const { return gpu_bytes_; }
+
+    /**
+     * Hands over the gpu buffers to be deleted, they are generated again if ever rendered again.
+     * Only once the render thread can no longer see this mesh
+     * @return Bytes that were uploaded to them
+     */
+    size_t release_gpu(unsigned int &vao_out, unsigned int &vbo_out);
 
     // new_mesh is optional, if non-null is swapped in and old mesh is returned
     ChunkMeshRaw *on_mesh_update(size_t new_size, ChunkMeshRaw *new_mesh);
@@ -78,8 +96,12 @@ private:
     ChunkMeshRaw *mesh_;
     unsigned int mesh_size_ = 0;
 
+    uint64_t version_ = 0;
+
+    // only touched by the render thread, or once it can no longer see this mesh
     unsigned int vao_ = 0, vbo_ = 0;
-    bool dirty_;
+    uint64_t uploaded_version_ = 0;
+    size_t gpu_bytes_ = 0;
 
     // chunk coords
     int x_, z_;
@@ -117,13 +139,40 @@ public:
     bool merge_faces_with_neighbour(Chunk *neighbour_chunk, ChunkNeighbour side);
 
     /**
-     * @param alternate If not null, is swapped with current mesh
-     * @return Old mesh if swapped, otherwise null
+     * Merges faces between neighbouring chunks of an n*n region, so only its outer border is left for
+     * the loader to merge. Laid out as in IGenerator::generate_region, null entries are skipped
      */
-    ChunkMeshRaw *populate_mesh(ChunkMeshRaw *alternate);
+    static void merge_region(Chunk **chunks, int n);
+
+    /**
+     * Meshes the given terrain with the configured mesher, safe to call from any thread
+     *
+     * @param size_hint Expected size, e.g. of the previous mesh
+     * @return Number of words written
+     */
+    static size_t build_mesh(const ChunkTerrain &terrain, ChunkMeshRaw &mesh_out, size_t size_hint = 0);
+
+    inline const ChunkTerrain &terrain() const { return terrain_; }
+
+    /**
+     * Swaps in a mesh built elsewhere with build_mesh
+     * @return Old mesh
+     */
+    inline ChunkMeshRaw *swap_mesh(ChunkMeshRaw *mesh, size_t size) { return mesh_.on_mesh_update(size, mesh); }
+
+    // identifies the latest mesh requested for this chunk, so older async results can be discarded
+    inline uint64_t mesh_ticket() const { return mesh_ticket_; }
+
+    inline void set_mesh_ticket(uint64_t ticket) { mesh_ticket_ = ticket; }
+
+    // set while the chunk is in the loader's finalization queue, so it is only queued once
+    inline std::atomic_bool &finalization_queued() { return finalization_queued_; }
 
     void reset_for_cache();
 
+    // terrain differs from what is stored, e.g. newly generated. chunks restored from disk are clean
+    inline bool dirty() const { return dirty_; }
+
     inline ChunkMesh *mesh() { return &mesh_; }
 
     // set load time to now
@@ -137,8 +186,13 @@ private:
 
     ChunkTerrain terrain_;
     ChunkMesh mesh_;
+    uint64_t mesh_ticket_ = 0;
+    std::atomic_bool finalization_queued_{false};
+    bool dirty_ = false;
 
     friend class IGenerator; // to allow direct access to terrain_
+    friend class RegionStore; // to restore terrain_
+    friend class WorldPack; // to restore terrain_
 };
 
 
@@ -0,0 +1,87 @@
+#include "cache.h"
+
+ChunkCache::ChunkCache(size_t budget_bytes) : budget_(budget_bytes) {
+
+}
+
+Chunk *ChunkCache::take(ChunkId_t chunk_id) {
+    auto it = lookup_.find(chunk_id);
+    if (it == lookup_.end()) {
+        misses_++;
+        return nullptr;
+    }
+
+    hits_++;
+    Entry &e = *it->second;
+    Chunk *chunk = e.chunk_;
+
+    bytes_ -= e.bytes_;
+    entries_.erase(it->second);
+    lookup_.erase(it);
+    count_ = entries_.size();
+    return chunk;
+}
+
+uint64_t ChunkCache::put(Chunk *chunk, size_t bytes, std::vector<Chunk *> &evicted_out) {
+    ChunkId_t chunk_id = chunk->id();
+
+    // replacing a stale copy
+    auto existing = lookup_.find(chunk_id);
+    if (existing != lookup_.end()) {
+        Entry &e = *existing->second;
+        if (e.chunk_ != chunk) {
+            evicted_out.push_back(e.chunk_);
+            evictions_++;
+        }
+        bytes_ -= e.bytes_;
+        entries_.erase(existing->second);
+        lookup_.erase(existing);
+    }
+
+    uint64_t ticket = next_ticket_++;
+    entries_.push_front({chunk_id, chunk, bytes, ticket});
+    lookup_[chunk_id] = entries_.begin();
+    bytes_ += bytes;
+    count_ = entries_.size();
+
+    evict_to_fit(budget_, evicted_out);
+    return ticket;
+}
+
+bool ChunkCache::holds(ChunkId_t chunk_id, uint64_t ticket) const {
+    auto it = lookup_.find(chunk_id);
+    return it != lookup_.end() && it->second->ticket_ == ticket;
+}
+
+void ChunkCache::set_budget(size_t budget_bytes, std::vector<Chunk *> &evicted_out) {
+    budget_ = budget_bytes;
+    evict_to_fit(budget_bytes, evicted_out);
+}
+
+void ChunkCache::clear(std::vector<Chunk *> &out) {
+    for (Entry &e : entries_)
+        out.push_back(e.chunk_);
+
+    entries_.clear();
+    lookup_.clear();
+    bytes_ = 0;
+    count_ = 0;
+}
+
+ChunkCache::Stats ChunkCache::stats() const {
+    return {hits_, misses_, evictions_, count_, bytes_, budget_};
+}
+
+void ChunkCache::evict_to_fit(size_t budget_bytes, std::vector<Chunk *> &evicted_out) {
+    while (bytes_ > budget_bytes && !entries_.empty()) {
+        Entry &lru = entries_.back();
+        evicted_out.push_back(lru.chunk_);
+        bytes_ -= lru.bytes_;
+        evictions_++;
+
+        lookup_.erase(lru.id_);
+        entries_.pop_back();
+    }
+
+    count_ = entries_.size();
+}
@@ -0,0 +1,74 @@
+#ifndef VOXELS_CACHE_H
+#define VOXELS_CACHE_H
+
+#include <atomic>
+#include <list>
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+#include "world/chunk.h"
+
+// chunks that have left the load range, least recently used evicted first to stay within a byte budget
+class ChunkCache {
+public:
+    struct Stats {
+        uint64_t hits_, misses_, evictions_;
+        size_t count_, bytes_, budget_;
+    };
+
+    explicit ChunkCache(size_t budget_bytes);
+
+    /**
+     * Removes the chunk from the cache on a hit
+     * @return Null on a miss
+     */
+    Chunk *take(ChunkId_t chunk_id);
+
+    /**
+     * Inserts as the most recently used
+     * @param evicted_out Appended with chunks evicted to make room, possibly including this one if it can never fit
+     * @return Ticket unique to this insertion, see holds
+     */
+    uint64_t put(Chunk *chunk, size_t bytes, std::vector<Chunk *> &evicted_out);
+
+    // evicts until within the new budget
+    void set_budget(size_t budget_bytes, std::vector<Chunk *> &evicted_out);
+
+    // removes everything without counting evictions
+    void clear(std::vector<Chunk *> &out);
+
+    // does not count as a hit or miss
+    inline bool contains(ChunkId_t chunk_id) const { return lookup_.find(chunk_id) != lookup_.end(); }
+
+    // true if the chunk has stayed in the cache since the put that returned the ticket
+    bool holds(ChunkId_t chunk_id, uint64_t ticket) const;
+
+    inline size_t size() const { return entries_.size(); }
+
+    inline size_t bytes() const { return bytes_; }
+
+    inline size_t budget() const { return budget_; }
+
+    // safe from any thread
+    Stats stats() const;
+
+private:
+    struct Entry {
+        ChunkId_t id_;
+        Chunk *chunk_;
+        size_t bytes_;
+        uint64_t ticket_;
+    };
+
+    // most recently used at the front
+    std::list<Entry> entries_;
+    boost::unordered_map<ChunkId_t, std::list<Entry>::iterator> lookup_;
+
+    std::atomic<size_t> bytes_{0}, budget_, count_{0};
+    uint64_t next_ticket_ = 1;
+    std::atomic<uint64_t> hits_{0}, misses_{0}, evictions_{0};
+
+    void evict_to_fit(size_t budget_bytes, std::vector<Chunk *> &evicted_out);
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef VOXELS_CONCURRENT_POOL_H
+#define VOXELS_CONCURRENT_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+// process wide index of the calling thread, assigned on first use and never reused
+inline unsigned int pool_thread_index() {
+    static std::atomic_uint next{0};
+    thread_local unsigned int index = next++;
+    return index;
+}
+
+/**
+ * Object pool usable from any thread. Each thread allocates from and frees into its own cache without
+ * locking, only going to the shared central list to refill an empty cache or spill a full one. Objects can
+ * be freed by a different thread to the one that allocated them
+ *
+ * @tparam Recycler If given, freed objects are reset with it instead of destroyed, so e.g. buffers keep their
+ * capacity, and new_object hands them back as they are. The central list then only keeps a cache's worth,
+ * the rest are destroyed so idle objects can't pin memory
+ */
+template<typename T, typename Recycler = void>
+class ConcurrentObjectPool {
+    static constexpr bool kRecycles = !std::is_void<Recycler>::value;
+
+public:
+    // threads beyond this many have no cache and always use the central list
+    static constexpr unsigned int kMaxThreads = 64;
+
+    /**
+     * @param cache_size Objects each thread holds on to before spilling half of them to the central list
+     */
+    explicit ConcurrentObjectPool(size_t cache_size) : cache_size_(std::max<size_t>(cache_size, 2)) {}
+
+    // objects not yet deleted are leaked, no other thread may be using the pool
+    ~ConcurrentObjectPool() {
+        for (LocalCache &cache : caches_) {
+            for (void *mem : cache.free_)
+                destroy(mem);
+        }
+
+        for (void *mem : central_)
+            destroy(mem);
+    }
+
+    ConcurrentObjectPool(const ConcurrentObjectPool &) = delete;
+
+    ConcurrentObjectPool &operator=(const ConcurrentObjectPool &) = delete;
+
+    // null if out of memory. a recycled object is returned as it is, without the arguments
+    template<typename... Args>
+    T *new_object(Args &&... args) {
+        bool recycled;
+        void *mem = take(recycled);
+        if (mem == nullptr)
+            return nullptr;
+
+        if (recycled)
+            return static_cast<T *>(mem);
+
+        try {
+            return new(mem) T(std::forward<Args>(args)...);
+        } catch (...) {
+            give(mem);
+            throw;
+        }
+    }
+
+    void delete_object(T *object) {
+        if constexpr (kRecycles)
+            Recycler()(*object);
+        else
+            object->~T();
+        give(object);
+    }
+
+    // objects currently allocated from the system, in use or not
+    inline size_t allocated() const { return allocated_; }
+
+private:
+    struct alignas(64) LocalCache {
+        std::vector<void *> free_;
+    };
+
+    const size_t cache_size_;
+
+    // indexed by pool_thread_index, only ever touched by that thread
+    std::array<LocalCache, kMaxThreads> caches_;
+
+    boost::mutex central_lock_;
+    std::vector<void *> central_;
+
+    std::atomic<size_t> allocated_{0};
+
+    inline LocalCache *local_cache() {
+        unsigned int index = pool_thread_index();
+        return index < kMaxThreads ? &caches_[index] : nullptr;
+    }
+
+    // recycled_out is set if the memory still holds a constructed object
+    void *take(bool &recycled_out) {
+        recycled_out = kRecycles;
+        LocalCache *cache = local_cache();
+        if (cache == nullptr) {
+            boost::lock_guard<boost::mutex> lock(central_lock_);
+            if (!central_.empty()) {
+                void *mem = central_.back();
+                central_.pop_back();
+                return mem;
+            }
+        } else {
+            if (cache->free_.empty())
+                refill(cache->free_);
+
+            if (!cache->free_.empty()) {
+                void *mem = cache->free_.back();
+                cache->free_.pop_back();
+                return mem;
+            }
+        }
+
+        recycled_out = false;
+        return allocate();
+    }
+
+    void give(void *mem) {
+        LocalCache *cache = local_cache();
+        if (cache == nullptr) {
+            {
+                boost::lock_guard<boost::mutex> lock(central_lock_);
+                if (!kRecycles || central_.size() < cache_size_) {
+                    central_.push_back(mem);
+                    return;
+                }
+            }
+
+            destroy(mem);
+            return;
+        }
+
+        if (cache->free_.capacity() < cache_size_)
+            cache->free_.reserve(cache_size_);
+
+        cache->free_.push_back(mem);
+        if (cache->free_.size() >= cache_size_)
+            spill(cache->free_);
+    }
+
+    // takes up to half a cache from the central list
+    void refill(std::vector<void *> &free) {
+        boost::lock_guard<boost::mutex> lock(central_lock_);
+        size_t n = std::min(cache_size_ / 2, central_.size());
+        free.insert(free.end(), central_.end() - n, central_.end());
+        central_.resize(central_.size() - n);
+    }
+
+    // gives half the cache to the central list, keeping the most recently freed
+    void spill(std::vector<void *> &free) {
+        size_t n = free.size() / 2, keep = n;
+        {
+            boost::lock_guard<boost::mutex> lock(central_lock_);
+            if (kRecycles)
+                keep = std::min(n, cache_size_ - std::min(cache_size_, central_.size()));
+            central_.insert(central_.end(), free.begin(), free.begin() + keep);
+        }
+
+        for (size_t i = keep; i < n; ++i)
+            destroy(free[i]);
+        free.erase(free.begin(), free.begin() + n);
+    }
+
+    void *allocate() {
+        void *mem = ::operator new(sizeof(T), std::align_val_t(alignof(T)), std::nothrow);
+        if (mem != nullptr)
+            allocated_++;
+        return mem;
+    }
+
+    void release(void *mem) {
+        ::operator delete(mem, std::align_val_t(alignof(T)));
+        allocated_--;
+    }
+
+    // memory from a free list, which only holds live objects if recycling
+    void destroy(void *mem) {
+        if constexpr (kRecycles)
+            static_cast<T *>(mem)->~T();
+        release(mem);
+    }
+};
+
+#endif
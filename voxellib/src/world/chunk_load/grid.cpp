@@ -0,0 +1,146 @@
+#include <cassert>
+#include "grid.h"
+
+static int grid_size(int radius) {
+    int size = 1;
+    while (size < 2 * radius + 1)
+        size <<= 1;
+    return size;
+}
+
+ChunkGrid::ChunkGrid(int radius) : size_(grid_size(radius)), slots_(size_ * size_), window_(0, 0, window_radius()) {
+
+}
+
+ChunkState ChunkGrid::get(ChunkId_t chunk_id, Chunk **chunk_out) const {
+    int x, z;
+    ChunkId_deconstruct(chunk_id, x, z);
+
+    Chunk *chunk = nullptr;
+    ChunkState state = ChunkState::kUnloaded;
+
+    if (window_.contains(x, z)) {
+        // every chunk in the window is in its slot
+        const Slot &s = slot(x, z);
+        if (s.occupied() && s.id_ == chunk_id) {
+            chunk = s.chunk_;
+            state = s.state_;
+        }
+    } else {
+        auto it = overflow_.find(chunk_id);
+        if (it != overflow_.end()) {
+            chunk = it->second.first;
+            state = it->second.second;
+        }
+    }
+
+    if (chunk_out != nullptr)
+        *chunk_out = chunk;
+    return state;
+}
+
+void ChunkGrid::set(ChunkId_t chunk_id, Chunk *chunk, ChunkState state) {
+    int x, z;
+    ChunkId_deconstruct(chunk_id, x, z);
+
+    if (!window_.contains(x, z)) {
+        if (state == ChunkState::kUnloaded)
+            overflow_.erase(chunk_id);
+        else
+            overflow_[chunk_id] = {chunk, state};
+        return;
+    }
+
+    Slot &s = slot(x, z);
+    assert(!s.occupied() || s.id_ == chunk_id); // anything else must have been migrated out
+
+    if (state == ChunkState::kUnloaded) {
+        if (s.occupied()) {
+            s = Slot();
+            count_--;
+        }
+        return;
+    }
+
+    if (!s.occupied())
+        count_++;
+    s.id_ = chunk_id;
+    s.chunk_ = chunk;
+    s.state_ = state;
+}
+
+void ChunkGrid::recentre(int cx, int cz, int radius) {
+    if (radius > window_radius()) {
+        resize(radius);
+    }
+
+    LoadRange window(cx, cz, window_radius());
+    if (window == window_)
+        return;
+
+    std::vector<ChunkId_t> leaving, entering;
+    window_.difference(window, leaving);
+    window.difference(window_, entering);
+    window_ = window;
+
+    // out of the window into the fallback map
+    for (ChunkId_t c : leaving) {
+        int x, z;
+        ChunkId_deconstruct(c, x, z);
+        Slot &s = slot(x, z);
+
+        if (s.occupied() && s.id_ == c) {
+            overflow_[c] = {s.chunk_, s.state_};
+            s = Slot();
+            count_--;
+        }
+    }
+
+    // and back in, if it was waiting outside
+    for (ChunkId_t c : entering) {
+        auto it = overflow_.find(c);
+        if (it == overflow_.end())
+            continue;
+
+        int x, z;
+        ChunkId_deconstruct(c, x, z);
+        Slot &s = slot(x, z);
+        assert(!s.occupied());
+
+        s.id_ = c;
+        s.chunk_ = it->second.first;
+        s.state_ = it->second.second;
+        count_++;
+        overflow_.erase(it);
+    }
+}
+
+void ChunkGrid::resize(int radius) {
+    std::vector<Slot> old;
+    old.swap(slots_);
+
+    size_ = grid_size(radius);
+    slots_.assign(size_ * size_, Slot());
+    count_ = 0;
+
+    // reinsert everything against the same centre
+    int cx, cz;
+    ChunkId_deconstruct(window_.centre(), cx, cz);
+    window_ = LoadRange(cx, cz, window_radius());
+
+    auto overflow = std::move(overflow_);
+    overflow_.clear();
+
+    for (const Slot &s : old) {
+        if (s.occupied())
+            set(s.id_, s.chunk_, s.state_);
+    }
+    for (const auto &e : overflow)
+        set(e.first, e.second.first, e.second.second);
+}
+
+void ChunkGrid::clear() {
+    slots_.assign(slots_.size(), Slot());
+    count_ = 0;
+    overflow_.clear();
+}
@@ -0,0 +1,83 @@
+#ifndef VOXELS_GRID_H
+#define VOXELS_GRID_H
+
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+#include "state.h"
+#include "range.h"
+#include "world/chunk.h"
+
+/**
+ * Maps chunk id -> (Chunk instance, state).
+ * Chunks in a square window around the centre live in a dense ring buffer indexed by
+ * (x mod N, z mod N), so looking one up is a mask and a tag compare rather than a hash.
+ * Anything outside the window falls back to a hash map, e.g. chunks still generating
+ * after the centre has moved away
+ */
+class ChunkGrid {
+public:
+    // the window covers at least radius around the centre
+    explicit ChunkGrid(int radius);
+
+    ChunkState get(ChunkId_t chunk_id, Chunk **chunk_out = nullptr) const;
+
+    // removes if kUnloaded
+    void set(ChunkId_t chunk_id, Chunk *chunk, ChunkState state);
+
+    /**
+     * Moves the window, migrating chunks between the ring buffer and the fallback map.
+     * Only touches the strips entering the window, and regrows if radius no longer fits
+     */
+    void recentre(int cx, int cz, int radius);
+
+    void clear();
+
+    inline size_t size() const { return count_ + overflow_.size(); }
+
+    // number of chunks in the fallback map
+    inline size_t overflow_size() const { return overflow_.size(); }
+
+    // f(ChunkId_t, Chunk *, ChunkState), must not modify the grid
+    template<typename F>
+    void for_each(F &&f) const {
+        for (const Slot &slot : slots_) {
+            if (slot.occupied())
+                f(slot.id_, slot.chunk_, slot.state_);
+        }
+
+        for (const auto &e : overflow_)
+            f(e.first, e.second.first, e.second.second);
+    }
+
+private:
+    // empty if kUnloaded, kChunkIdInit can't be used as a tag as it is also a valid id (-1, -1)
+    struct Slot {
+        ChunkId_t id_ = kChunkIdInit;
+        Chunk *chunk_ = nullptr;
+        ChunkState state_ = ChunkState::kUnloaded;
+
+        inline bool occupied() const { return state_ != ChunkState::kUnloaded; }
+    };
+
+    // power of 2 so the mod is a mask, also correct for negative coords
+    int size_;
+    std::vector<Slot> slots_;
+    size_t count_ = 0;
+
+    LoadRange window_;
+    boost::unordered_map<ChunkId_t, std::pair<Chunk *, ChunkState>> overflow_;
+
+    inline Slot &slot(int x, int z) { return slots_[(x & (size_ - 1)) * size_ + (z & (size_ - 1))]; }
+
+    inline const Slot &slot(int x, int z) const {
+        return slots_[(x & (size_ - 1)) * size_ + (z & (size_ - 1))];
+    }
+
+    // radius of the largest window that fits
+    inline int window_radius() const { return (size_ - 1) / 2; }
+
+    void resize(int radius);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include "memory.h"
+
+constexpr boost::chrono::milliseconds MemoryGovernor::kRadiusStepInterval;
+
+const char *memory_category_str(MemoryCategory category) {
+    switch (category) {
+        case kMemoryChunks:
+            return "chunks";
+        case kMemoryMeshes:
+            return "meshes";
+        case kMemoryCache:
+            return "cache";
+        case kMemoryGpu:
+            return "gpu";
+        default:
+            return "unknown";
+    }
+}
+
+MemoryGovernor::MemoryGovernor(size_t budget_bytes, size_t cache_budget_bytes) :
+        budget_(budget_bytes),
+        max_cache_budget_(cache_budget_bytes),
+        cache_budget_(cache_budget_bytes) {
+    for (auto &used : used_)
+        used = 0;
+}
+
+size_t MemoryGovernor::used(MemoryCategory category) const {
+    // may briefly dip below zero between threads
+    int64_t bytes = used_[category];
+    return bytes > 0 ? static_cast<size_t>(bytes) : 0;
+}
+
+size_t MemoryGovernor::total() const {
+    size_t total = 0;
+    for (int i = 0; i < kMemoryCategoryCount; ++i)
+        total += used(static_cast<MemoryCategory>(i));
+    return total;
+}
+
+int MemoryGovernor::govern(int requested_radius, size_t &cache_budget_out, Clock::time_point now) {
+    size_t total = this->total();
+    size_t cache_budget = cache_budget_;
+    int limit = radius_limit_;
+    int radius = limit > 0 ? std::min(limit, requested_radius) : requested_radius;
+    bool can_step = now - last_radius_step_ >= kRadiusStepInterval;
+    settling_ = false;
+
+    if (total > budget_) {
+        // the cache goes first, down to whatever it holds that is not over budget
+        size_t excess = total - budget_;
+        size_t cached = used(kMemoryCache);
+        cache_budget = cached > excess ? std::min(cache_budget, cached - excess) : 0;
+
+        // then the radius, a step at a time
+        if (cached < excess && radius > 1) {
+            if (can_step) {
+                radius--;
+                limit = radius;
+                last_radius_step_ = now;
+            } else {
+                settling_ = true;
+            }
+        }
+    } else if (total < low_watermark()) {
+        size_t headroom = low_watermark() - total;
+
+        if (limit > 0 && limit < requested_radius) {
+            // the radius comes back first as it is what is visible
+            if (can_step) {
+                radius++;
+                limit = radius >= requested_radius ? 0 : radius;
+                last_radius_step_ = now;
+            } else {
+                settling_ = true;
+            }
+        } else {
+            limit = 0;
+            cache_budget = std::min(max_cache_budget_, cache_budget + headroom);
+        }
+    }
+
+    cache_budget_ = cache_budget;
+    radius_limit_ = limit;
+    cache_budget_out = cache_budget;
+    return radius;
+}
+
+MemoryGovernor::Stats MemoryGovernor::stats() const {
+    Stats stats;
+    stats.total_ = 0;
+    for (int i = 0; i < kMemoryCategoryCount; ++i) {
+        stats.used_[i] = used(static_cast<MemoryCategory>(i));
+        stats.total_ += stats.used_[i];
+    }
+
+    stats.budget_ = budget_;
+    stats.cache_budget_ = cache_budget_;
+    stats.radius_limit_ = radius_limit_;
+    return stats;
+}
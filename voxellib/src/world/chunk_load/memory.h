@@ -0,0 +1,81 @@
+#ifndef VOXELS_MEMORY_H
+#define VOXELS_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <boost/chrono.hpp>
+
+enum MemoryCategory {
+    kMemoryChunks, // terrain of chunks in the load range
+    kMemoryMeshes, // vertices held by those chunks
+    kMemoryCache,  // terrain of cached chunks
+    kMemoryGpu,    // uploaded vertex buffers
+
+    kMemoryCategoryCount,
+};
+
+const char *memory_category_str(MemoryCategory category);
+
+// accounts for chunk memory by category, and keeps the total within a budget by first shrinking the
+// chunk cache and then the radius actually loaded
+class MemoryGovernor {
+public:
+    typedef boost::chrono::steady_clock Clock;
+
+    // radius is not changed again for this long, so memory freed by the last change can be accounted for
+    static constexpr auto kRadiusStepInterval = boost::chrono::milliseconds(500);
+
+    struct Stats {
+        size_t used_[kMemoryCategoryCount];
+        size_t total_, budget_;
+        size_t cache_budget_;
+
+        // 0 if not limited
+        int radius_limit_;
+    };
+
+    MemoryGovernor(size_t budget_bytes, size_t cache_budget_bytes);
+
+    // safe from any thread
+    inline void add(MemoryCategory category, int64_t delta) { used_[category] += delta; }
+
+    // safe from any thread
+    inline void set(MemoryCategory category, size_t bytes) { used_[category] = bytes; }
+
+    size_t used(MemoryCategory category) const;
+
+    size_t total() const;
+
+    /**
+     * Loader thread only, once per tick
+     * @param requested_radius Radius the world wants loaded
+     * @param cache_budget_out Set to the byte budget the chunk cache should shrink or grow to
+     * @return Radius to actually load
+     */
+    int govern(int requested_radius, size_t &cache_budget_out, Clock::time_point now = Clock::now());
+
+    // true if the last govern wanted to change the radius but had to wait, so should be called again soon
+    inline bool settling() const { return settling_; }
+
+    // safe from any thread
+    Stats stats() const;
+
+private:
+    std::atomic<int64_t> used_[kMemoryCategoryCount];
+    const size_t budget_;
+
+    // grown back towards once under the low watermark
+    const size_t max_cache_budget_;
+    std::atomic<size_t> cache_budget_;
+
+    // 0 if not limited
+    std::atomic_int radius_limit_{0};
+    Clock::time_point last_radius_step_;
+    bool settling_ = false;
+
+    // restored only once this far under budget, to avoid flapping
+    size_t low_watermark() const { return budget_ - budget_ / 4; }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef VOXELS_MPSC_QUEUE_H
+#define VOXELS_MPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+/**
+ * Lock-free queue with any number of producers and a single consumer.
+ * Producers push onto an intrusive stack with a CAS, the consumer takes the whole stack
+ * at once with an exchange and reverses it, so nothing is ever popped concurrently (no ABA)
+ */
+template<typename Entry>
+class MpscQueue {
+public:
+    MpscQueue() = default;
+
+    MpscQueue(const MpscQueue &) = delete;
+
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    ~MpscQueue() {
+        delete_all(head_.exchange(nullptr));
+    }
+
+    // any thread
+    void push(Entry &&e) {
+        Node *node = new Node{std::move(e), head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(node->next_, node, std::memory_order_release,
+                                            std::memory_order_relaxed));
+    }
+
+    void push(const Entry &e) { push(Entry(e)); }
+
+    /**
+     * Any thread. Only pushes if queued was clear, and sets it.
+     * The consumer clears it again when it takes the entry, so an entry is queued at most once
+     * @return If pushed
+     */
+    bool push_once(const Entry &e, std::atomic_bool &queued) {
+        if (queued.exchange(true, std::memory_order_acq_rel))
+            return false;
+
+        push(e);
+        return true;
+    }
+
+    /**
+     * Consumer only. Appends everything pushed so far, oldest first
+     * @return Number appended
+     */
+    size_t drain(std::vector<Entry> &out) {
+        Node *node = head_.exchange(nullptr, std::memory_order_acquire);
+
+        size_t start = out.size();
+        while (node != nullptr) {
+            Node *next = node->next_;
+            out.push_back(std::move(node->entry_));
+            delete node;
+            node = next;
+        }
+
+        // stack order is newest first
+        std::reverse(out.begin() + start, out.end());
+        return out.size() - start;
+    }
+
+    inline bool empty() const { return head_.load(std::memory_order_relaxed) == nullptr; }
+
+private:
+    struct Node {
+        Entry entry_;
+        Node *next_;
+    };
+
+    std::atomic<Node *> head_{nullptr};
+
+    static void delete_all(Node *node) {
+        while (node != nullptr) {
+            Node *next = node->next_;
+            delete node;
+            node = next;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include <algorithm>
+#include "range.h"
+
+bool LoadRange::contains(ChunkId_t chunk_id) const {
+    int x, z;
+    ChunkId_deconstruct(chunk_id, x, z);
+    return contains(x, z);
+}
+
+void LoadRange::difference(const LoadRange &other, std::vector<ChunkId_t> &out) const {
+    if (empty())
+        return;
+
+    const int x_min = cx_ - radius_, x_max = cx_ + radius_;
+    const int z_min = cz_ - radius_, z_max = cz_ + radius_;
+
+    for (int z = z_min; z <= z_max; ++z) {
+        // whole row if other doesn't cover it
+        if (other.empty() || std::abs(z - other.cz_) > other.radius_) {
+            for (int x = x_min; x <= x_max; ++x)
+                out.push_back(ChunkId(x, z));
+            continue;
+        }
+
+        // otherwise either side of the overlap
+        const int overlap_min = std::max(x_min, other.cx_ - other.radius_);
+        const int overlap_max = std::min(x_max, other.cx_ + other.radius_);
+        if (overlap_min > overlap_max) {
+            for (int x = x_min; x <= x_max; ++x)
+                out.push_back(ChunkId(x, z));
+            continue;
+        }
+
+        for (int x = x_min; x < overlap_min; ++x)
+            out.push_back(ChunkId(x, z));
+        for (int x = overlap_max + 1; x <= x_max; ++x)
+            out.push_back(ChunkId(x, z));
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef VOXELS_RANGE_H
+#define VOXELS_RANGE_H
+
+#include <cstdlib>
+#include <vector>
+#include "world/chunk.h"
+
+// square of chunks within radius of a centre chunk
+class LoadRange {
+public:
+    // empty
+    LoadRange() = default;
+
+    LoadRange(int cx, int cz, int radius) : cx_(cx), cz_(cz), radius_(radius) {}
+
+    inline bool empty() const { return radius_ < 0; }
+
+    inline ChunkId_t centre() const { return ChunkId(cx_, cz_); }
+
+    inline bool contains(int x, int z) const {
+        return !empty() && std::abs(x - cx_) <= radius_ && std::abs(z - cz_) <= radius_;
+    }
+
+    bool contains(ChunkId_t chunk_id) const;
+
+    inline bool operator==(const LoadRange &o) const {
+        return (empty() && o.empty()) || (cx_ == o.cx_ && cz_ == o.cz_ && radius_ == o.radius_);
+    }
+
+    inline bool operator!=(const LoadRange &o) const { return !(*this == o); }
+
+    /**
+     * Appends the chunks in this range that are not in other, i.e. the strips entering
+     * this range when moving from other, or leaving it when moving to other.
+     * Costs one step per row plus one per chunk appended, rather than per chunk in range
+     */
+    void difference(const LoadRange &other, std::vector<ChunkId_t> &out) const;
+
+private:
+    int cx_ = 0, cz_ = 0;
+    int radius_ = -1;
+};
+
+#endif
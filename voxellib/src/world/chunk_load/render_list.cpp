@@ -0,0 +1,50 @@
+#include "render_list.h"
+
+void EpochReclaimer::retire(std::function<void()> &&free) {
+    // anything entering after the bump can't see it
+    retired_.emplace_back(epoch_.fetch_add(1), std::move(free));
+}
+
+void EpochReclaimer::reclaim() {
+    const uint64_t reader = reader_epoch_;
+
+    while (!retired_.empty() && (reader == kIdle || reader > retired_.front().first)) {
+        retired_.front().second();
+        retired_.pop_front();
+    }
+}
+
+RenderList::RenderList() : current_(new RenderSnapshot{0, {}}) {
+
+}
+
+RenderList::~RenderList() {
+    delete current_.load();
+
+    // reader is long gone
+    reclaim();
+}
+
+const RenderSnapshot &RenderList::begin_read() {
+    reclaimer_.enter();
+    return *current_.load();
+}
+
+void RenderList::end_read() {
+    reclaimer_.exit();
+}
+
+void RenderList::publish(std::vector<RenderSnapshot::Entry> &&entries) {
+    auto *snapshot = new RenderSnapshot{next_version_++, std::move(entries)};
+    const RenderSnapshot *old = current_.exchange(snapshot);
+
+    reclaimer_.retire([old]() { delete old; });
+}
+
+void RenderList::reclaim() {
+    for (auto &free : unpublished_)
+        reclaimer_.retire(std::move(free));
+    unpublished_.clear();
+
+    reclaimer_.reclaim();
+}
@@ -0,0 +1,95 @@
+#ifndef VOXELS_RENDER_LIST_H
+#define VOXELS_RENDER_LIST_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "world/chunk.h"
+
+// immutable once published by the loader
+struct RenderSnapshot {
+    struct Entry {
+        // gl state, only touched by the render thread
+        ChunkMesh *mesh_;
+
+        const ChunkMeshRaw *vertices_;
+        size_t size_;
+
+        // changes whenever vertices_ does, so the render thread knows to upload
+        uint64_t version_;
+    };
+
+    uint64_t version_;
+    std::vector<Entry> entries_;
+};
+
+/**
+ * Epoch based reclamation between a single reader (render) thread and a single writer (loader) thread.
+ * The writer unpublishes something, then retires it. It is freed once the reader is either idle or
+ * has entered since, so can no longer be holding it
+ */
+class EpochReclaimer {
+public:
+    // reader, before loading anything published
+    inline void enter() { reader_epoch_ = epoch_.load(); }
+
+    // reader, once finished with everything loaded since enter
+    inline void exit() { reader_epoch_ = kIdle; }
+
+    // writer, must already be unpublished
+    void retire(std::function<void()> &&free);
+
+    // writer, frees whatever is safe to
+    void reclaim();
+
+    inline bool pending() const { return !retired_.empty(); }
+
+private:
+    static constexpr uint64_t kIdle = UINT64_MAX;
+
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<uint64_t> reader_epoch_{kIdle};
+
+    // oldest first
+    std::deque<std::pair<uint64_t, std::function<void()>>> retired_;
+};
+
+/**
+ * Publishes versioned RenderSnapshots for the render thread to pick up without locking.
+ * Old snapshots, and anything only reachable through them, are freed through an EpochReclaimer
+ */
+class RenderList {
+public:
+    RenderList();
+
+    ~RenderList();
+
+    // render thread, the snapshot stays valid until end_read
+    const RenderSnapshot &begin_read();
+
+    void end_read();
+
+    // loader thread, takes ownership
+    void publish(std::vector<RenderSnapshot::Entry> &&entries);
+
+    // loader thread, for anything a published snapshot may reference, e.g. unloaded chunks and old meshes
+    inline void retire(std::function<void()> &&free) { unpublished_.push_back(std::move(free)); }
+
+    // loader thread, once this tick's changes have been published. frees whatever the render thread can
+    // no longer see
+    void reclaim();
+
+    inline bool pending() const { return !unpublished_.empty() || reclaimer_.pending(); }
+
+private:
+    std::atomic<const RenderSnapshot *> current_;
+    uint64_t next_version_ = 1;
+    EpochReclaimer reclaimer_;
+
+    // retired since the last reclaim, which may still be in the current snapshot until the next publish
+    std::vector<std::function<void()>> unpublished_;
+};
+
+#endif
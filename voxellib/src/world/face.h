@@ -2,7 +2,8 @@
 #define VOXELS_FACE_H
 
 #include <array>
-#include <bitset>
+#include <cstddef>
+#include <cstdint>
 
 // TODo store bitwise value outside
 enum Face {
@@ -29,17 +30,30 @@ void face_offset(Face face, size_t *out);
 
 Face face_opposite(Face face);
 
-class FaceVisibility : std::bitset<kFaceCount> {
+// one bit per face, packed into a single byte so Block stays 2 bytes
+class FaceVisibility {
 public:
-    bool visible(Face face) const;
+    typedef uint8_t Mask;
 
-    void set_fully_visible();
+    constexpr static Mask kAllVisible = (1u << kFaceCount) - 1;
+
+    FaceVisibility() = default;
+
+    explicit constexpr FaceVisibility(Mask mask) : mask_(mask) {}
+
+    inline bool visible(Face face) const { return (mask_ >> face) & 1u; }
+
+    inline void set_fully_visible() { mask_ = kAllVisible; }
 
     void set_face_visible(Face face, bool visible);
 
     // no faces visible
-    bool invisible() const;
+    inline bool invisible() const { return mask_ == 0; }
+
+    inline Mask mask() const { return mask_; }
 
+private:
+    Mask mask_ = 0;
 };
 
 
@@ -5,6 +5,8 @@
 #include <netdb.h>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
+#include <vector>
 #include <boost/thread/locks.hpp>
 #include <dlfcn.h>
 
@@ -15,7 +17,43 @@
 #include <boost/thread/locks.hpp>
 
 int IGenerator::generate(ChunkId_t chunk_id, int seed, Chunk *chunk) {
-    return generate(chunk_id, seed, chunk->terrain_);
+    int ret = generate(chunk_id, seed, chunk->terrain_);
+    chunk->dirty_ = true;
+    return ret;
+}
+
+int IGenerator::generate_region(ChunkId_t corner, int n, int seed, Chunk **chunks, int *results_out) {
+    int x, z;
+    ChunkId_deconstruct(corner, x, z);
+
+    std::vector<ChunkTerrain *> terrains(n * n);
+    for (int i = 0; i < n * n; ++i)
+        terrains[i] = chunks[i] != nullptr ? &chunks[i]->terrain_ : nullptr;
+
+    generate_terrain_region(x, z, n, seed, terrains.data(), results_out);
+
+    int ret = kErrorSuccess;
+    for (int i = 0; i < n * n; ++i) {
+        if (chunks[i] == nullptr)
+            continue;
+
+        chunks[i]->dirty_ = true;
+        if (ret == kErrorSuccess && results_out[i] != kErrorSuccess)
+            ret = results_out[i];
+    }
+
+    return ret;
+}
+
+void IGenerator::generate_terrain_region(int chunk_x, int chunk_z, int n, int seed,
+                                         ChunkTerrain **terrains_out, int *results_out) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            ChunkTerrain *terrain = terrains_out[i * n + j];
+            if (terrain != nullptr)
+                results_out[i * n + j] = generate(ChunkId(chunk_x + i, chunk_z + j), seed, *terrain);
+        }
+    }
 }
 
 int DummyGenerator::generate(ChunkId_t chunk_id, int seed, ChunkTerrain &terrain_out) {
@@ -23,9 +61,8 @@ int DummyGenerator::generate(ChunkId_t chunk_id, int seed, ChunkTerrain &terrain
     for (size_t x = 0; x < kChunkWidth; ++x) {
         for (size_t z = 0; z < kChunkDepth; ++z) {
             for (size_t y = 0; y < 1; ++y) {
-                Block &b = terrain_out[{x, y, z}];
-                b.type_ = x == 0 || x == kChunkWidth - 1 ||
-                          z == 0 || z == kChunkDepth - 1 ? BlockType::kGrass : BlockType::kStone;
+                terrain_out.set_type({x, y, z}, x == 0 || x == kChunkWidth - 1 ||
+                                                z == 0 || z == kChunkDepth - 1 ? BlockType::kGrass : BlockType::kStone);
             }
         }
     }
@@ -87,8 +124,7 @@ int PythonGenerator::generate(ChunkId_t chunk_id, int seed, ChunkTerrain &terrai
     }
 
     for (int i = 0; i < kBlocksPerChunk; i++) {
-        Block &b = terrain_out[i];
-        b.type_ = static_cast<BlockType>(buf[i]);
+        terrain_out.set_type(i, static_cast<BlockType>(buf[i]));
     }
 
 
@@ -128,6 +164,7 @@ int PythonGenerator::get_socket() {
 boost::shared_mutex NativeGenerator::kHandleMutex;
 void *NativeGenerator::kHandle;
 generate_t NativeGenerator::kFunc;
+generate_region_t NativeGenerator::kRegionFunc;
 bool NativeGenerator::kDirty;
 
 int NativeGenerator::ensure_handle() {
@@ -150,6 +187,11 @@ int NativeGenerator::ensure_handle() {
             return kErrorDl;
         }
 
+        // older generators only do a chunk at a time
+        kRegionFunc = (generate_region_t) dlsym(kHandle, "generate_region");
+        if (kRegionFunc == nullptr)
+            LOG_F(INFO, "native generator has no generate_region, generating regions a chunk at a time");
+
         LOG_F(INFO, "reloaded native generator");
         kDirty = false;
     }
@@ -172,6 +214,31 @@ int NativeGenerator::generate(ChunkId_t chunk_id, int seed, ChunkTerrain &terrai
     }
 }
 
+void NativeGenerator::generate_terrain_region(int chunk_x, int chunk_z, int n, int seed,
+                                              ChunkTerrain **terrains_out, int *results_out) {
+    int ret;
+    if ((ret = ensure_handle()) != kErrorSuccess) {
+        std::fill(results_out, results_out + n * n, ret);
+        return;
+    }
+
+    // hold lock while inside function
+    boost::shared_lock<boost::shared_mutex> lock(kHandleMutex);
+    if (kRegionFunc != nullptr) {
+        ret = kRegionFunc(chunk_x, chunk_z, n, seed, terrains_out);
+        std::fill(results_out, results_out + n * n, ret);
+        return;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            ChunkTerrain *terrain = terrains_out[i * n + j];
+            if (terrain != nullptr)
+                results_out[i * n + j] = kFunc(chunk_x + i, chunk_z + j, seed, *terrain);
+        }
+    }
+}
+
 void NativeGenerator::mark_dirty() {
     boost::unique_lock<boost::shared_mutex> lock(kHandleMutex);
     kDirty = true;
@@ -7,10 +7,25 @@
 
 class IGenerator {
 public:
+    virtual ~IGenerator() = default;
+
     virtual int generate(ChunkId_t chunk_id, int seed, Chunk *chunk) final;
 
+    /**
+     * Generates an n*n region of chunks together
+     * @param corner Chunk with the lowest x and z in the region
+     * @param chunks chunks[i * n + j] is at corner + (i, j), null entries are skipped
+     * @param results_out Set to the error code of each non-null chunk
+     * @return kErrorSuccess if every chunk was generated
+     */
+    virtual int generate_region(ChunkId_t corner, int n, int seed, Chunk **chunks, int *results_out) final;
+
 protected:
     virtual int generate(ChunkId_t chunk_id, int seed, ChunkTerrain &terrain_out) = 0;
+
+    // one chunk at a time unless overridden
+    virtual void generate_terrain_region(int chunk_x, int chunk_z, int n, int seed,
+                                         ChunkTerrain **terrains_out, int *results_out);
 };
 
 class DummyGenerator : public IGenerator {
@@ -35,6 +50,10 @@ public:
 
     static void mark_dirty();
 
+protected:
+    void generate_terrain_region(int chunk_x, int chunk_z, int n, int seed,
+                                 ChunkTerrain **terrains_out, int *results_out) override;
+
 private:
     static int ensure_handle();
 
@@ -42,6 +61,7 @@ private:
     static bool kDirty;
     static void *kHandle;
     static generate_t kFunc;
+    static generate_region_t kRegionFunc; // null if not exported
 };
 
 
@@ -1,21 +1,51 @@
+#include <algorithm>
+#include <boost/chrono.hpp>
 #include "error.h"
 #include "util.h"
 #include "loader.h"
 #include "config.h"
 #include "world.h"
-#include "iterators.h"
 #include "generation/generator.h"
 
+// cached chunks keep their terrain but not their mesh
+static const size_t kCachedChunkBytes = sizeof(Chunk);
+
+static int64_t mesh_bytes(const ChunkMeshRaw *mesh) {
+    return mesh != nullptr ? static_cast<int64_t>(mesh->capacity() * sizeof(PackedVertex)) : 0;
+}
+
+// squared distance from the centre, so the nearest chunks are built first
+static Priority distance_priority(ChunkId_t chunk_id, int cx, int cz) {
+    int x, z;
+    ChunkId_deconstruct(chunk_id, x, z);
+
+    int dx = x - cx;
+    int dz = z - cz;
+    return static_cast<Priority>(dx * dx + dz * dz);
+}
+
+// added to prefetched chunks so they are only built once everything in range is
+static const Priority kPrefetchPriority = 1u << 24;
+
+// load range shifted towards the heading, no further than its radius so the two always overlap
+static LoadRange prefetch_range(int cx, int cz, int hx, int hz, int radius) {
+    int dx = std::max(-radius, std::min(radius, hx - cx));
+    int dz = std::max(-radius, std::min(radius, hz - cz));
+    return LoadRange(cx + dx, cz + dz, radius);
+}
+
+// one per worker, shared by generation and pack fallbacks
+static IGenerator *worker_generator() {
+    thread_local IGenerator *gen = config::new_generator(); // TODO ever deleted?
+    return gen;
+}
+
 WorldLoader *WorldLoader::create(int seed) {
     WorldLoader *loader = new WorldLoader(seed);
     boost::thread thread([loader]() {
         // wait a tad for game to properly start :^)
         boost::this_thread::sleep(boost::posix_time::milliseconds(100));
-        while (1) {
-            loader->tick();
-            boost::this_thread::yield();
-            // TODO sleep?
-        }
+        loader->run();
     });
 
     return loader;
@@ -23,22 +53,121 @@ WorldLoader *WorldLoader::create(int seed) {
 
 WorldLoader::WorldLoader(int seed) :
         seed_(seed),
-        pool_(config::kTerrainThreadWorkers),
+        pool_(config::kTerrainThreadWorkers, config::kTerrainScheduling),
+        chunks_(config::kInitialLoadedChunkRadius),
+        chunk_cache_(config::kChunkCacheBytes),
+        memory_(config::kMemoryBudgetBytes, config::kChunkCacheBytes),
         unload_barrier_(boost::posix_time::microsec_clock::local_time()),
         chunk_pool_(128), mesh_pool_(128) {
 
-    // TODO set based on available memory
-    cache_limit_ = 128;
-    LOG_F(INFO, "chunk cache size set to %lu", cache_limit_);
+    LOG_F(INFO, "chunk cache budget set to %zu bytes", chunk_cache_.budget());
+    LOG_F(INFO, "memory budget set to %zu bytes", config::kMemoryBudgetBytes);
+
+    if (!config::kStoragePath.empty()) {
+        store_.reset(new RegionStore(config::kStoragePath, [this](Chunk *chunk) {
+            finalization_queue_.push_once(chunk->id(), chunk->finalization_queued());
+            wake();
+        }, [this](ChunkId_t chunk_id, const CancellationTokenPtr &token) {
+            store_misses_.push({chunk_id, token});
+            wake();
+        }));
+    }
+
+    if (!config::kPackPath.empty()) {
+        auto pack = std::make_shared<WorldPack>();
+        if (pack->open(config::kPackPath) != kErrorSuccess) {
+            LOG_F(WARNING, "not using world pack %s, its chunks will be generated", config::kPackPath.c_str());
+        } else if (pack->seed() != seed_ || pack->generator() != config::kGenType) {
+            // would not line up with the generated chunks around it
+            LOG_F(WARNING, "not using world pack %s, it was generated with seed %d and generator %u instead of "
+                           "seed %d and generator %d", config::kPackPath.c_str(), pack->seed(), pack->generator(),
+                  seed_, static_cast<int>(config::kGenType));
+        } else {
+            LOG_F(INFO, "serving %zu chunks from world pack %s", pack->size(), config::kPackPath.c_str());
+            pack_ = std::move(pack);
+        }
+    }
+}
+
+void WorldLoader::update_world_centre(ChunkId_t world_centre, int loaded_chunk_radius, ChunkId_t heading) {
+    int cx, cz, hx, hz;
+    ChunkId_deconstruct(world_centre, cx, cz);
+    ChunkId_deconstruct(heading, hx, hz);
+
+    {
+        boost::unique_lock lock(world_state_.lock_);
+        if (cx == world_state_.cx_ && cz == world_state_.cz_ && loaded_chunk_radius == world_state_.load_radius_ &&
+            hx == world_state_.hx_ && hz == world_state_.hz_)
+            return;
+
+        world_state_.cx_ = cx;
+        world_state_.cz_ = cz;
+        world_state_.hx_ = hx;
+        world_state_.hz_ = hz;
+        world_state_.load_radius_ = loaded_chunk_radius;
+    }
+
+    wake();
 }
 
-void WorldLoader::update_world_centre(ChunkId_t world_centre, int loaded_chunk_radius) {
-    boost::unique_lock lock(world_state_.lock_);
-    ChunkId_deconstruct(world_centre, world_state_.cx_, world_state_.cz_);
-    world_state_.load_radius_ = loaded_chunk_radius;
+void WorldLoader::shutdown() {
+    stop_ = true;
+    wake();
+
+    boost::unique_lock<boost::mutex> lock(stopped_lock_);
+    while (!stopped_)
+        stopped_cond_.wait(lock);
 }
 
-void WorldLoader::tick() {
+void WorldLoader::wake() {
+    {
+        boost::lock_guard lock(wake_lock_);
+        woken_ = true;
+    }
+    wake_.notify_one();
+}
+
+void WorldLoader::run() {
+    const unsigned int rate = config::kLoaderMaxTickRate;
+    const auto min_interval = boost::chrono::microseconds(rate > 0 ? 1000000 / rate : 0);
+
+    while (!stop_) {
+        auto next_tick = boost::chrono::steady_clock::now() + min_interval;
+        bool busy = tick();
+
+        {
+            boost::unique_lock<boost::mutex> lock(wake_lock_);
+            while (!busy && !woken_)
+                wake_.wait(lock);
+            woken_ = false;
+        }
+
+        boost::this_thread::sleep_until(next_tick);
+    }
+
+    save_and_stop();
+}
+
+void WorldLoader::save_and_stop() {
+    LOG_F(INFO, "stopping loader");
+
+    // tasks already running finish, queued ones are dropped, so no worker touches a chunk after this
+    pool_.shutdown();
+
+    // also honours a discard requested just before shutting down
+    really_unload_all_chunks();
+
+    if (store_)
+        store_->flush();
+
+    {
+        boost::lock_guard<boost::mutex> lock(stopped_lock_);
+        stopped_ = true;
+    }
+    stopped_cond_.notify_all();
+}
+
+bool WorldLoader::tick() {
     // handle unload all
     if (unload_all_chunks_) {
         really_unload_all_chunks();
@@ -46,60 +175,113 @@ void WorldLoader::tick() {
     }
 
     // determine new chunks to load and unload
-    int cx, cz;
-    int load_radius, load_radius_chunk_count;
+    int cx, cz, hx, hz;
+    int requested_radius;
     {
         boost::shared_lock lock(world_state_.lock_);
         cx = world_state_.cx_;
         cz = world_state_.cz_;
-        load_radius = world_state_.load_radius_;
+        hx = world_state_.hx_;
+        hz = world_state_.hz_;
+        requested_radius = world_state_.load_radius_;
     }
-    load_radius_chunk_count = loaded_radius_chunk_count(load_radius);
 
-    per_frame_chunks_.clear();
-    ITERATOR_CHUNK_SPIRAL_BEGIN(load_radius_chunk_count, cx, cz)
-        ChunkId_t c = ChunkId(x, z);
+    // possibly less than asked for if over the memory budget
+    int load_radius = govern_memory(requested_radius);
+
+    LoadRange range(cx, cz, load_radius);
 
-        // mark this chunk as in range
-        per_frame_chunks_.insert(c);
+    // nothing to spare for chunks that may never be needed when short of memory
+    LoadRange prefetch;
+    if (load_radius == requested_radius)
+        prefetch = prefetch_range(cx, cz, hx, hz, load_radius);
 
+    // nearest chunks first after moving, and prefetched chunks now in range no longer last
+    ChunkId_t centre = ChunkId(cx, cz);
+    if (centre != last_centre_ || range != loaded_range_) {
+        last_centre_ = centre;
+        pool_.reprioritise([cx, cz, range](TaskTag tag, Priority) {
+            Priority priority = distance_priority(tag, cx, cz);
+            return range.contains(tag) ? priority : priority + kPrefetchPriority;
+        });
+    }
+
+    // keep the dense part of the chunk map around the centre
+    chunks_.recentre(cx, cz, load_radius);
+
+    // only the strips entering and leaving the range since last tick
+    std::vector<ChunkId_t> entering, leaving;
+
+    if (range != loaded_range_) {
+        range.difference(loaded_range_, entering);
+        loaded_range_.difference(range, leaving);
+        loaded_range_ = range;
+    }
+
+    for (ChunkId_t c : entering) {
         if (get_chunk(c) == ChunkState::kUnloaded)
             request_chunk(c);
-    ITERATOR_CHUNK_SPIRAL_END
-
-    for (auto &e : chunks_) {
-        ChunkState state = e.second.second;
-        if (state == ChunkState::kRenderable &&
-            per_frame_chunks_.find(e.first) == per_frame_chunks_.end()) {
-            // loaded and not in range
-            to_unload_.insert(e.first);
-        }
     }
 
+    for (ChunkId_t c : leaving) {
+        // still wanted ahead, let it finish generating into the cache
+        if (prefetch.contains(c) && get_chunk(c) == ChunkState::kLoadingTerrain)
+            continue;
+        leave_range(c);
+    }
+
+    update_prefetch(range, prefetch);
+
+    retry_failed_generation();
+    generate_store_misses();
+
     // finalization
-    auto &finalization = finalization_queue_.swap();
+    std::vector<ChunkId_t> &finalization = finalization_batch_;
+    finalization.clear();
+    pending_finalization_.clear();
+    finalization_queue_.drain(pending_finalization_);
 
     // first pass to update states
-    for (auto it = finalization.begin(); it != finalization.end();) {
-        ChunkId_t c = *it;
-
-        // marked for unload
-        if (should_unload(c) || get_chunk(c) == ChunkState::kUnloaded) {
-            it = finalization.erase(it);
+    for (ChunkId_t c : pending_finalization_) {
+        // take it off the queue, skipping duplicates and entries for chunks since unloaded
+        Chunk *chunk;
+        if (get_chunk(c, &chunk) == ChunkState::kUnloaded || !chunk->finalization_queued().exchange(false))
             continue;
+
+        // generated, too late to cancel
+        generating_.erase(c);
+
+        if (get_chunk(c) == ChunkState::kLoadingTerrain) {
+            // requested before everything was unloaded, so possibly by another generator
+            if (chunk->was_loaded_before(unload_barrier_)) {
+                unload_chunk(chunk, false);
+                if (loaded_range_.contains(c))
+                    request_chunk(c);
+                continue;
+            }
+
+            // prefetched, or left the range while being generated when too late to cancel it
+            if (!loaded_range_.contains(c)) {
+                unload_chunk(chunk);
+                continue;
+            }
         }
 
-        DLOG_F(INFO, "iterated %s in finalization, setting to loaded", ChunkId_str(c).c_str());
-        set_chunk_state(c, ChunkState::kLoadedTerrain);
-        it++;
+        // renderable chunks stay renderable with their current mesh until the new one is ready
+        if (get_chunk(c) == ChunkState::kLoadingTerrain) {
+            DLOG_F(INFO, "iterated %s in finalization, setting to loaded", ChunkId_str(c).c_str());
+            set_chunk_state(c, ChunkState::kLoadedTerrain);
+        }
+        finalization.push_back(c);
     }
 
+    // for membership checks against this batch
+    std::sort(finalization.begin(), finalization.end());
+
     // second pass to merge neighbours
     for (ChunkId_t c : finalization) {
-        assert(!should_unload(c)); // should have been filtered out in first pass
-
         Chunk *chunk;
-        ChunkState state = get_chunk(c, &chunk);
+        get_chunk(c, &chunk);
         ChunkNeighbours neighbours;
         chunk->neighbours(neighbours);
 
@@ -124,17 +306,21 @@ void WorldLoader::tick() {
                 case ChunkState::kRenderable:
                 case ChunkState::kLoadedTerrain:
                     // terrain available to merge with
-                    // TODO use result?
                     bool merged = chunk->merge_faces_with_neighbour(n_chunk, n_side);
                     neighbours_done++;
 
-                    if (merged && n_state == ChunkState::kRenderable) {
+                    // neighbours in this batch merge with this chunk themselves. others may have
+                    // been meshed before this chunk had terrain, including kLoadedTerrain ones
+                    // whose mesh is still being built. a restored chunk may already count as merged,
+                    // so also check the neighbour's side
+                    bool n_merged = n_chunk->terrain().has_merged_faces(n_side.opposite());
+                    if ((merged || !n_merged) && !std::binary_search(finalization.begin(), finalization.end(), n_id)) {
                         // avoid propagation of updates for already complete chunks
                         DLOG_F(INFO,
                                "posting a merely update finalization task for chunk %s (by chunk %s neighbour %d)",
                                CHUNKSTR(n_chunk), CHUNKSTR(chunk), i);
 
-                        finalization_queue_.add(n_id);
+                        finalization_queue_.push_once(n_id, n_chunk->finalization_queued());
                     }
                     break;
             }
@@ -152,74 +338,54 @@ void WorldLoader::tick() {
 
         if (!update_mesh) {
             // try again next tick
-            finalization_queue_.add(c);
+            finalization_queue_.push_once(c, chunk->finalization_queued());
             continue;
         } else {
-            ChunkMeshRaw *new_mesh = nullptr;
-
-            // new mesh to swap out with current mesh for renderable chunks
-            if (state == ChunkState::kRenderable)
-                new_mesh = mesh_pool_.new_object();
-
-            // generate mesh
-            ChunkMeshRaw *old_mesh = chunk->populate_mesh(new_mesh);
-
-            // reclaim old mesh
-            if (old_mesh != nullptr) {
-                mesh_pool_.delete_object(old_mesh);
-            }
-
-            // update state to renderable
-            if (state != ChunkState::kRenderable) {
-                set_chunk_state(c, ChunkState::kRenderable);
-
-                {
-                    boost::lock_guard lock(renderable_lock_);
-                    renderable_[c] = chunk->mesh();
-                }
-            }
+            request_mesh(chunk);
         }
 
     }
 
-    // unload queued chunks
-    for (auto it = to_unload_.begin(); it != to_unload_.end();) {
-        if (currently_rendering_) {
-            it++;
-            continue;
-        }
+    // everything requested this tick, batched into regions
+    post_generation();
 
-        Chunk *c;
-        get_chunk(*it, &c);
-        unload_chunk(c);
-        it = to_unload_.erase(it);
-    }
+    // swap in finished meshes
+    apply_meshes();
 
-    // flush cache
-    if (flush_cache_) {
-        flush_cache_ = false;
-        flush_cache_wrt_distance();
-    }
+    publish_renderables();
+
+    // neighbours requeued by this tick, chunks and meshes the render thread may still be using, or
+    // a radius change waiting on the last one
+    return !finalization_queue_.empty() || render_list_.pending() || memory_.settling();
 }
 
-ChunkState WorldLoader::get_chunk(ChunkId_t chunk_id, Chunk **chunk_out) {
-    auto it = chunks_.find(chunk_id);
+int WorldLoader::govern_memory(int requested_radius) {
+    if (requested_radius < 0)
+        return requested_radius;
+
+    memory_.set(kMemoryChunks, chunks_.size() * sizeof(Chunk));
+    memory_.set(kMemoryCache, chunk_cache_.bytes());
 
-    Chunk *ret_chunk;
-    ChunkState ret_state;
+    size_t cache_budget;
+    int radius = memory_.govern(requested_radius, cache_budget);
 
-    if (it == chunks_.end()) {
-        ret_chunk = nullptr;
-        ret_state = ChunkState::kUnloaded;
-    } else {
-        ret_chunk = it->second.first;
-        ret_state = it->second.second;
+    if (cache_budget != chunk_cache_.budget()) {
+        std::vector<Chunk *> evicted;
+        chunk_cache_.set_budget(cache_budget, evicted);
+        for (Chunk *chunk : evicted)
+            evict_chunk(chunk);
+
+        memory_.set(kMemoryCache, chunk_cache_.bytes());
     }
 
-    if (chunk_out != nullptr)
-        *chunk_out = ret_chunk;
+    if (radius != requested_radius)
+        DLOG_F(INFO, "over memory budget, loading radius %d instead of %d", radius, requested_radius);
 
-    return ret_state;
+    return radius;
+}
+
+ChunkState WorldLoader::get_chunk(ChunkId_t chunk_id, Chunk **chunk_out) {
+    return chunks_.get(chunk_id, chunk_out);
 }
 
 void WorldLoader::set_chunk_state(Chunk *chunk, ChunkState new_state) {
@@ -229,33 +395,55 @@ void WorldLoader::set_chunk_state(Chunk *chunk, ChunkState new_state) {
     if (old_state == new_state)
         return;
 
-    if (new_state == ChunkState::kUnloaded)
-        chunks_.erase(c);
-    else
-        chunks_[c] = {chunk, new_state};
+    chunks_.set(c, chunk, new_state);
 
     DLOG_F(INFO, "set chunk %s state from %s to %s", CHUNKSTR(chunk),
            old_state.str().c_str(), new_state.str().c_str());
 }
 
 void WorldLoader::set_chunk_state(ChunkId_t chunk_id, ChunkState new_state) {
-    auto it = chunks_.find(chunk_id);
-    assert(it != chunks_.end()); // must already be in the map
+    Chunk *chunk;
+    ChunkState state = get_chunk(chunk_id, &chunk);
+    assert(state != ChunkState::kUnloaded); // must already be in the map
 
-    set_chunk_state(it->second.first, new_state);
+    set_chunk_state(chunk, new_state);
 }
 
 
-void WorldLoader::request_chunk(ChunkId_t chunk_id) {
+void WorldLoader::update_prefetch(const LoadRange &range, const LoadRange &prefetch) {
+    if (prefetch == prefetch_range_)
+        return;
+
+    std::vector<ChunkId_t> ahead, behind;
+    prefetch.difference(prefetch_range_, ahead);
+    prefetch_range_.difference(prefetch, behind);
+    prefetch_range_ = prefetch;
+
+    // anything in range is already handled
+    for (ChunkId_t c : ahead) {
+        if (!range.contains(c) && get_chunk(c) == ChunkState::kUnloaded)
+            request_chunk(c, true);
+    }
+
+    // no longer heading that way, cancel generation if not yet started
+    for (ChunkId_t c : behind) {
+        if (!range.contains(c))
+            leave_range(c);
+    }
+}
+
+void WorldLoader::request_chunk(ChunkId_t chunk_id, bool prefetch) {
+    // already prefetched, leave it in the cache until it is actually in range
+    if (prefetch && chunk_cache_.contains(chunk_id))
+        return;
+
     // check cache
-    auto cache_result = chunk_cache_.find(chunk_id);
-    if (cache_result != chunk_cache_.end()) {
+    Chunk *cached_chunk = chunk_cache_.take(chunk_id);
+    if (cached_chunk != nullptr) {
         // use terrain from cache
-        Chunk *cached_chunk = cache_result->second;
         DLOG_F(INFO, "uncached requested chunk %s", CHUNKSTR(cached_chunk));
-        chunk_cache_.erase(cache_result);
         set_chunk_state(cached_chunk, ChunkState::kLoadedTerrain);
-        finalization_queue_.add(chunk_id);
+        finalization_queue_.push_once(chunk_id, cached_chunk->finalization_queued());
         return;
     }
 
@@ -268,125 +456,363 @@ void WorldLoader::request_chunk(ChunkId_t chunk_id) {
         if (chunk) chunk_pool_.delete_object(chunk);
         return;
     }
+    memory_.add(kMemoryMeshes, mesh_bytes(mesh));
 
     DLOG_F(INFO, "allocated new chunk %s", CHUNKSTR(chunk));
     chunk->mark_load_time_now();
     set_chunk_state(chunk, ChunkState::kLoadingTerrain);
 
-    pool_.post([this, chunk_id, mesh, chunk]() {
-        thread_local IGenerator *gen = config::new_generator(); // TODO ever deleted?
+    auto token = std::make_shared<CancellationToken>();
+    generating_[chunk_id] = token;
 
-        int ret = gen->generate(chunk_id, seed_, chunk);
-        if (ret == kErrorSuccess) {
-            DLOG_F(INFO, "successfully generated terrain for %s", CHUNKSTR(chunk));
-            chunk->post_terrain_update();
-            finalization_queue_.add(chunk_id);
-            return;
-        }
+    Priority priority = chunk_priority(chunk_id) + (prefetch ? kPrefetchPriority : 0);
 
-        LOG_F(WARNING, "failed to generate chunk %s with seed %d: %d", CHUNKSTR(chunk), seed_, ret);
-        unload_chunk(chunk, false);
-    });
+    // pack chunks are never dirtied so the store can't have anything newer
+    if (pack_ && pack_->contains(chunk_id)) {
+        pending_unpack_.push_back({chunk, token, priority});
+        return;
+    }
+
+    // from disk if saved before, otherwise generated once the store says it is missing
+    if (store_) {
+        store_->load(chunk, token);
+        return;
+    }
+
+    pending_generation_.push_back({chunk, token, priority});
 }
 
-void WorldLoader::unload_chunk(Chunk *chunk, bool allow_cache) {
-    set_chunk_state(chunk, ChunkState::kUnloaded);
+void WorldLoader::generate_store_misses() {
+    std::vector<StoreMiss> misses;
+    store_misses_.drain(misses);
 
-    {
-        boost::lock_guard lock(renderable_lock_);
-        int n = renderable_.erase(chunk->id());
-        if (n > 0)
-            DLOG_F(INFO, "removed renderable chunk %s", CHUNKSTR(chunk));
+    for (StoreMiss &miss : misses) {
+        ChunkId_t c = miss.chunk_id_;
+
+        // only if still waiting on this request, it may have been cancelled and requested again since
+        Chunk *chunk;
+        auto token = generating_.find(c);
+        if (get_chunk(c, &chunk) != ChunkState::kLoadingTerrain || token == generating_.end() ||
+            token->second != miss.token_)
+            continue;
+
+        Priority priority = chunk_priority(c) + (loaded_range_.contains(c) ? 0 : kPrefetchPriority);
+        pending_generation_.push_back({chunk, std::move(miss.token_), priority});
     }
+}
 
-    if (allow_cache) {
-        if (chunk_cache_.size() >= cache_limit_) {
-            flush_cache_ = true;
-        } else {
-            // put into cache
-            chunk->reset_for_cache();
-            chunk_cache_[chunk->id()] = chunk;
-            DLOG_F(INFO, "put chunk %s in the cache (%lu/%lu)", CHUNKSTR(chunk), chunk_cache_.size(), cache_limit_);
-            return;
+void WorldLoader::post_generation() {
+    if (pending_generation_.empty() && pending_unpack_.empty())
+        return;
+
+    // the pool starts the token, so a chunk cancelled while queued is never touched
+    for (PendingGeneration &p : pending_unpack_) {
+        Chunk *chunk = p.chunk_;
+        pool_.post_batch([this, chunk, pack = pack_]() {
+            int ret = pack->load(chunk);
+            if (ret != kErrorSuccess) {
+                LOG_F(WARNING, "failed to unpack chunk %s, generating it instead: %d", CHUNKSTR(chunk), ret);
+                ret = worker_generator()->generate(chunk->id(), seed_, chunk);
+                if (ret != kErrorSuccess) {
+                    LOG_F(WARNING, "failed to generate chunk %s with seed %d: %d", CHUNKSTR(chunk), seed_, ret);
+                    generation_failures_.push(chunk->id());
+                    wake();
+                    return;
+                }
+                chunk->post_terrain_update();
+            }
+
+            DLOG_F(INFO, "unpacked chunk %s", CHUNKSTR(chunk));
+            finalization_queue_.push_once(chunk->id(), chunk->finalization_queued());
+            wake();
+        }, p.priority_, chunk->id(), std::move(p.token_));
+    }
+    pending_unpack_.clear();
+
+    const int n = config::kGenerationBatchSize;
+    struct Region {
+        std::vector<Chunk *> chunks_;
+        std::vector<CancellationTokenPtr> tokens_;
+
+        // of the most urgent chunk in it
+        Priority priority_;
+        TaskTag tag_;
+    };
+    boost::unordered_map<ChunkId_t, Region> regions;
+
+    for (PendingGeneration &p : pending_generation_) {
+        int x, z;
+        ChunkId_deconstruct(p.chunk_->id(), x, z);
+        int rx = floor_to_multiple(x, n);
+        int rz = floor_to_multiple(z, n);
+
+        Region &region = regions[ChunkId(rx, rz)];
+        if (region.chunks_.empty()) {
+            region.chunks_.resize(n * n, nullptr);
+            region.tokens_.resize(n * n);
+            region.priority_ = p.priority_;
+            region.tag_ = p.chunk_->id();
+        }
+
+        int i = (x - rx) * n + (z - rz);
+        region.chunks_[i] = p.chunk_;
+        region.tokens_[i] = std::move(p.token_);
+        if (p.priority_ < region.priority_) {
+            region.priority_ = p.priority_;
+            region.tag_ = p.chunk_->id();
         }
     }
+    pending_generation_.clear();
 
-    DLOG_F(INFO, "deleting chunk %s", CHUNKSTR(chunk));
+    for (auto &r : regions) {
+        ChunkId_t corner = r.first;
+        Region &region = r.second;
 
-    // delete now
-    ChunkMeshRaw *mesh = chunk->steal_mesh();
-    if (mesh != nullptr)
-        mesh_pool_.delete_object(mesh);
+        pool_.post_batch([this, corner, n, chunks = std::move(region.chunks_), tokens = std::move(region.tokens_)]() mutable {
+            IGenerator *gen = worker_generator();
 
-    {
-        boost::lock_guard lock(gl_garbage_lock_);
-        if (chunk->mesh()->vao() != 0)
-            gl_garbage_.emplace_back(chunk->mesh()->vao(), true);
-        if (chunk->mesh()->vbo() != 0)
-            gl_garbage_.emplace_back(chunk->mesh()->vbo(), false);
+            // chunks cancelled by now are dropped, the rest no longer can be
+            for (int i = 0; i < n * n; ++i) {
+                if (chunks[i] != nullptr && !tokens[i]->begin())
+                    chunks[i] = nullptr;
+            }
+
+            std::vector<int> results(n * n, kErrorSuccess);
+            gen->generate_region(corner, n, seed_, chunks.data(), results.data());
+
+            for (int i = 0; i < n * n; ++i) {
+                Chunk *chunk = chunks[i];
+                if (chunk == nullptr)
+                    continue;
+
+                // left for the loader to unload, it still owns the chunk map
+                if (results[i] != kErrorSuccess) {
+                    LOG_F(WARNING, "failed to generate chunk %s with seed %d: %d", CHUNKSTR(chunk), seed_, results[i]);
+                    generation_failures_.push(chunk->id());
+                    chunks[i] = nullptr;
+                    continue;
+                }
+
+                DLOG_F(INFO, "successfully generated terrain for %s", CHUNKSTR(chunk));
+                chunk->post_terrain_update();
+            }
+
+            // borders within the region are merged here, the loader only merges with chunks outside it
+            Chunk::merge_region(chunks.data(), n);
+
+            for (Chunk *chunk : chunks) {
+                if (chunk != nullptr)
+                    finalization_queue_.push_once(chunk->id(), chunk->finalization_queued());
+            }
+
+            wake();
+        }, region.priority_, region.tag_);
     }
 
-    chunk_pool_.delete_object(chunk);
+    pool_.post_batch_end();
 }
 
-bool WorldLoader::should_unload(ChunkId_t chunk_id) {
-    Chunk *chunk;
-    get_chunk(chunk_id, &chunk);
+void WorldLoader::retry_failed_generation() {
+    std::vector<ChunkId_t> failed;
+    generation_failures_.drain(failed);
 
-    // check if in unload set or was loaded before unload barrier
-    auto it = to_unload_.find(chunk_id);
-    bool unload = it != to_unload_.end() && !chunk->was_loaded_before(unload_barrier_);
+    for (ChunkId_t c : failed) {
+        // nothing else unloads a chunk once its generation has started
+        Chunk *chunk;
+        if (get_chunk(c, &chunk) != ChunkState::kLoadingTerrain)
+            continue;
 
-    if (unload && !currently_rendering_) {
-        to_unload_.erase(it);
-        unload_chunk(chunk);
+        generating_.erase(c);
+        unload_chunk(chunk, false);
+
+        if (loaded_range_.contains(c))
+            request_chunk(c);
     }
+}
+
+void WorldLoader::request_mesh(Chunk *chunk) {
+    uint64_t ticket = next_mesh_ticket_++;
+    chunk->set_mesh_ticket(ticket);
 
-    return unload;
+    ChunkId_t chunk_id = chunk->id();
+    size_t size_hint = chunk->mesh()->mesh_size();
+    auto terrain = std::make_shared<const ChunkTerrain>(chunk->terrain());
+
+    pool_.post([this, chunk_id, ticket, terrain, size_hint]() {
+        ChunkMeshRaw *mesh = mesh_pool_.new_object();
+        if (mesh == nullptr) {
+            LOG_F(ERROR, "failed to allocate mesh for %s", ChunkId_str(chunk_id).c_str());
+            return;
+        }
+
+        size_t size = Chunk::build_mesh(*terrain, *mesh, size_hint);
+        mesh_results_.push({chunk_id, ticket, mesh, size});
+        wake();
+    }, chunk_priority(chunk_id), chunk_id);
 }
 
-void WorldLoader::flush_cache_wrt_distance() {
-    int cx, cz, load_rad;
-    {
-        boost::shared_lock lock(world_state_.lock_);
-        cx = world_state_.cx_;
-        cz = world_state_.cz_;
-        load_rad = world_state_.load_radius_;
+void WorldLoader::apply_meshes() {
+    std::vector<MeshResult> &results = mesh_batch_;
+    results.clear();
+    mesh_results_.drain(results);
+
+    for (MeshResult &result : results) {
+        Chunk *chunk;
+        ChunkState state = get_chunk(result.chunk_id_, &chunk);
+
+        // chunk has since been unloaded or remeshed again
+        if (state == ChunkState::kUnloaded || chunk->mesh_ticket() != result.ticket_) {
+            mesh_pool_.delete_object(result.mesh_);
+            continue;
+        }
+
+        DLOG_F(INFO, "%s: new mesh is size %lu/%d", CHUNKSTR(chunk), result.size_, kChunkMeshSize);
+        ChunkMeshRaw *old_mesh = chunk->swap_mesh(result.mesh_, result.size_);
+        memory_.add(kMemoryMeshes, mesh_bytes(result.mesh_) - mesh_bytes(old_mesh));
+
+        // reclaim old mesh once the render thread has moved on from it
+        if (old_mesh != nullptr)
+            render_list_.retire([this, old_mesh]() { mesh_pool_.delete_object(old_mesh); });
+
+        // update state to renderable
+        if (state != ChunkState::kRenderable) {
+            set_chunk_state(chunk, ChunkState::kRenderable);
+            renderable_[result.chunk_id_] = chunk;
+        }
+        renderable_dirty_ = true;
     }
+}
 
-    const int chunk_flush_max_distance = load_rad; // TODO experiment
-    const int threshold = chunk_flush_max_distance * chunk_flush_max_distance;
+void WorldLoader::unload_chunk(Chunk *chunk, bool allow_cache) {
+    set_chunk_state(chunk, ChunkState::kUnloaded);
 
-    for (auto it = chunk_cache_.begin(); it != chunk_cache_.end(); ) {
-        int x, z;
-        ChunkId_deconstruct(it->first, x, z);
+    if (renderable_.erase(chunk->id()) > 0) {
+        renderable_dirty_ = true;
+        DLOG_F(INFO, "removed renderable chunk %s", CHUNKSTR(chunk));
+    }
+
+    if (allow_cache) {
+        // it is remeshed when it comes back anyway
+        ChunkMeshRaw *mesh = chunk->steal_mesh();
+        memory_.add(kMemoryMeshes, -mesh_bytes(mesh));
+        if (mesh != nullptr)
+            render_list_.retire([this, mesh]() { mesh_pool_.delete_object(mesh); });
+
+        chunk->reset_for_cache();
+
+        std::vector<Chunk *> evicted;
+        ChunkId_t chunk_id = chunk->id();
+        uint64_t ticket = chunk_cache_.put(chunk, kCachedChunkBytes, evicted);
+        DLOG_F(INFO, "put chunk %s in the cache (%zu bytes/%zu), evicting %zu", CHUNKSTR(chunk),
+               chunk_cache_.bytes(), chunk_cache_.budget(), evicted.size());
+
+        // the cache only charges for the chunk, so its gpu buffers go too once no longer drawn. unless it
+        // has been taken back out by then, when they may be drawn again and the chunk may be gone
+        render_list_.retire([this, chunk, chunk_id, ticket]() {
+            if (chunk_cache_.holds(chunk_id, ticket))
+                release_gpu(chunk);
+        });
+
+        for (Chunk *e : evicted)
+            evict_chunk(e);
+        return;
+    }
+
+    delete_chunk(chunk);
+}
+
+void WorldLoader::evict_chunk(Chunk *chunk) {
+    if (store_)
+        store_->save(chunk);
+
+    delete_chunk(chunk);
+}
+
+void WorldLoader::delete_chunk(Chunk *chunk) {
+    DLOG_F(INFO, "deleting chunk %s", CHUNKSTR(chunk));
+
+    // the render thread may still be drawing it
+    render_list_.retire([this, chunk]() {
+        ChunkMeshRaw *mesh = chunk->steal_mesh();
+        memory_.add(kMemoryMeshes, -mesh_bytes(mesh));
+        if (mesh != nullptr)
+            mesh_pool_.delete_object(mesh);
+
+        release_gpu(chunk);
+        chunk_pool_.delete_object(chunk);
+    });
+}
+
+void WorldLoader::release_gpu(Chunk *chunk) {
+    unsigned int vao, vbo;
+    size_t bytes = chunk->mesh()->release_gpu(vao, vbo);
+    memory_.add(kMemoryGpu, -static_cast<int64_t>(bytes));
 
-        int dx = cx - x;
-        int dz = cz - z;
-        int dist_sqr = (dx*dx) + (dz+dz);
+    boost::lock_guard lock(gl_garbage_lock_);
+    if (vao != 0)
+        gl_garbage_.emplace_back(vao, true);
+    if (vbo != 0)
+        gl_garbage_.emplace_back(vbo, false);
+}
 
-        if (dist_sqr > threshold) {
-            unload_chunk(it->second, false);
-            it = chunk_cache_.erase(it);
+void WorldLoader::publish_renderables() {
+    if (renderable_dirty_) {
+        renderable_dirty_ = false;
+
+        std::vector<RenderSnapshot::Entry> entries;
+        entries.reserve(renderable_.size());
+        for (auto &e : renderable_) {
+            ChunkMesh *mesh = e.second->mesh();
+            entries.push_back({mesh, &mesh->mesh(), static_cast<size_t>(mesh->mesh_size()), mesh->version()});
         }
-        else
-            it++;
+
+        render_list_.publish(std::move(entries));
     }
 
-    DLOG_F(INFO, "flushed chunk cache to %lu", chunk_cache_.size());
+    render_list_.reclaim();
 }
 
-void WorldLoader::get_renderable_chunks(std::vector<ChunkMesh *> &out) {
-    currently_rendering_ = true;
+void WorldLoader::leave_range(ChunkId_t chunk_id) {
+    Chunk *chunk;
+    switch (*get_chunk(chunk_id, &chunk)) {
+        case ChunkState::kUnloaded:
+            break;
+
+        case ChunkState::kLoadingTerrain: {
+            // drop generation if no worker has started it yet, otherwise caught in finalization
+            auto token = generating_.find(chunk_id);
+            if (token != generating_.end() && token->second->cancel()) {
+                DLOG_F(INFO, "cancelled generation of %s", CHUNKSTR(chunk));
+                generating_.erase(token);
+                unload_chunk(chunk, false);
+            }
+            break;
+        }
+
+        case ChunkState::kLoadedTerrain:
+            // not rendered yet, any mesh still being built is dropped when it arrives
+            unload_chunk(chunk);
+            break;
 
-    boost::lock_guard lock(renderable_lock_);
-    for (auto &it : renderable_) {
-        out.push_back(it.second);
+        case ChunkState::kRenderable:
+            // the render thread keeps drawing it until the next snapshot, then it is reclaimed
+            unload_chunk(chunk);
+            break;
     }
 }
 
+Priority WorldLoader::chunk_priority(ChunkId_t chunk_id) const {
+    int cx, cz;
+    ChunkId_deconstruct(last_centre_, cx, cz);
+    return distance_priority(chunk_id, cx, cz);
+}
+
+const RenderSnapshot &WorldLoader::get_renderable_chunks() {
+    return render_list_.begin_read();
+}
+
 void WorldLoader::finished_rendering() {
-    currently_rendering_ = false;
+    render_list_.end_read();
 }
 
 void WorldLoader::get_gl_goshdarn_garbage(std::vector<WorldLoader::GlGarbage> &out) {
@@ -397,41 +823,54 @@ void WorldLoader::get_gl_goshdarn_garbage(std::vector<WorldLoader::GlGarbage> &o
 void WorldLoader::really_unload_all_chunks() {
     LOG_F(INFO, "unloading all chunks");
 
-    // unload all before now
+    // anything still being generated from before now is dropped once finished
     unload_barrier_ = boost::posix_time::microsec_clock::local_time();
 
-    // no more rendering
-    {
-        boost::lock_guard lock(renderable_lock_);
-        renderable_.clear();
-    }
-
-    // wait for render to finish
-    while (currently_rendering_) {}
-
-    for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
-        ChunkState state = it->second.second;
-        switch (*state) {
-            case ChunkState::kUnloaded:
-                // nop
-                break;
-            case ChunkState::kLoadingTerrain:
-            case ChunkState::kLoadedTerrain:
-                // nop, will be cleansed by unload time barrier
-                break;
-
-            case ChunkState::kRenderable:
-                unload_chunk(it->second.first, false);
-                break;
+    // the render thread keeps drawing them until the next snapshot, no need to wait for it
+    std::vector<Chunk *> to_unload;
+    chunks_.for_each([&](ChunkId_t c, Chunk *chunk, ChunkState state) {
+        if (state != ChunkState::kLoadingTerrain) {
+            to_unload.push_back(chunk);
+            return;
         }
+
+        // drop if not started yet
+        auto token = generating_.find(c);
+        if (token != generating_.end() && token->second->cancel()) {
+            generating_.erase(token);
+            to_unload.push_back(chunk);
+        }
+    });
+
+    // saved terrain is stale too if the generator has changed
+    bool discard = discard_stored_.exchange(false);
+    if (store_ && discard)
+        store_->discard_all();
+
+    // and so is the pack, for the rest of the session
+    if (discard && pack_) {
+        LOG_F(INFO, "no longer serving chunks from world pack %s", config::kPackPath.c_str());
+        pack_.reset();
+    }
+
+    // unloading removes from chunks_, so not while iterating it
+    for (Chunk *chunk : to_unload) {
+        if (store_ && !discard && get_chunk(chunk->id()) != ChunkState::kLoadingTerrain)
+            store_->save(chunk);
+        unload_chunk(chunk, false);
     }
-    chunks_.clear();
 
     // clear cache
-    for (auto &it : chunk_cache_) {
-        unload_chunk(it.second, false);
+    std::vector<Chunk *> cached;
+    chunk_cache_.clear(cached);
+    for (Chunk *chunk : cached) {
+        if (discard)
+            delete_chunk(chunk);
+        else
+            evict_chunk(chunk);
     }
-    chunk_cache_.clear();
 
-    to_unload_.clear();
+    // everything in range is loaded again from scratch
+    loaded_range_ = LoadRange();
+    prefetch_range_ = LoadRange();
 }
@@ -4,11 +4,19 @@
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/atomic.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include "chunk.h"
 #include "threadpool.h"
-#include "world/chunk_load/double_buffered.h"
-#include "object_pool.hpp"
+#include "world/chunk_load/mpsc_queue.h"
+#include "world/chunk_load/range.h"
+#include "world/chunk_load/grid.h"
+#include "world/chunk_load/render_list.h"
+#include "world/chunk_load/cache.h"
+#include "world/chunk_load/memory.h"
+#include "world/chunk_load/concurrent_pool.h"
+#include "world/storage/region.h"
+#include "world/storage/pack.h"
 
 // lives in another thread
 class WorldLoader {
@@ -16,13 +24,27 @@ class WorldLoader {
 public:
     static WorldLoader *create(int seed);
 
-    void update_world_centre(ChunkId_t world_centre, int loaded_chunk_radius);
+    /**
+     * @param heading Chunk the centre is projected to move to, chunks towards it are prefetched
+     */
+    void update_world_centre(ChunkId_t world_centre, int loaded_chunk_radius, ChunkId_t heading);
 
     // no caching
     // includes chunks that are currently cached too
-    inline void unload_all_chunks() { unload_all_chunks_ = true; }
+    // @param discard_stored Also deletes saved chunks instead of saving these, e.g. if the generator has changed
+    inline void unload_all_chunks(bool discard_stored = false) {
+        if (discard_stored)
+            discard_stored_ = true;
+        unload_all_chunks_ = true;
+        wake();
+    }
+
+    // stops loading for good, then waits for everything loaded to be saved and written to disk
+    // nothing else may be called afterwards
+    void shutdown();
 
-    void get_renderable_chunks(std::vector<ChunkMesh *> &out);
+    // render thread, latest published snapshot which stays valid until finished_rendering
+    const RenderSnapshot &get_renderable_chunks();
 
     void finished_rendering();
 
@@ -32,46 +54,142 @@ public:
     };
     void get_gl_goshdarn_garbage(std::vector<GlGarbage> &out);
 
+    // safe from any thread
+    inline ChunkCache::Stats cache_stats() const { return chunk_cache_.stats(); }
+
+    // safe from any thread
+    inline MemoryGovernor::Stats memory_stats() const { return memory_.stats(); }
+
+    // render thread, as returned by ChunkMesh::prepare_render
+    inline void track_gpu_bytes(int64_t delta) { memory_.add(kMemoryGpu, delta); }
+
 private:
     WorldLoader(int seed);
     int seed_;
 
     ThreadPool pool_;
 
-    boost::unordered_map<ChunkId_t, ChunkMesh *> renderable_;
-    boost::mutex renderable_lock_;
+    // loader thread only, published to the render thread as snapshots when changed
+    boost::unordered_map<ChunkId_t, Chunk *> renderable_;
+    bool renderable_dirty_ = false;
+    RenderList render_list_;
+
+    // dense around the centre, hashed elsewhere
+    ChunkGrid chunks_;
+    ChunkCache chunk_cache_;
+
+    // shrinks the cache and the loaded radius when over budget
+    MemoryGovernor memory_;
+
+    boost::atomic_bool unload_all_chunks_{false};
+    boost::atomic_bool discard_stored_{false};
+
+    // set by shutdown, the loader thread saves everything and exits instead of ticking again
+    boost::atomic_bool stop_{false};
 
-    boost::atomic_bool currently_rendering_;
+    // notified once the loader thread has saved everything on shutdown, guarded by stopped_lock_
+    bool stopped_ = false;
+    boost::condition_variable stopped_cond_;
+    boost::mutex stopped_lock_;
 
-    boost::unordered_map<ChunkId_t, std::pair<Chunk *, ChunkState>> chunks_;
-    boost::unordered_map<ChunkId_t, Chunk *> chunk_cache_;
-    unsigned long cache_limit_;
+    // null if chunks are not saved
+    std::unique_ptr<RegionStore> store_;
 
-    boost::atomic_bool unload_all_chunks_;
+    // pre-baked chunks served ahead of the store, null if there is no pack or everything is being regenerated.
+    // Shared with unpack tasks, so it outlives any still running when dropped
+    std::shared_ptr<const WorldPack> pack_;
+
+    // chunks the store does not have, pushed by the I/O thread to be generated instead
+    struct StoreMiss {
+        ChunkId_t chunk_id_;
+        CancellationTokenPtr token_;
+    };
+    MpscQueue<StoreMiss> store_misses_;
 
     std::vector<GlGarbage> gl_garbage_;
     boost::mutex gl_garbage_lock_;
 
     // updated each tick by main thread
     struct {
-        int cx_, cz_;
-        int load_radius_;
+        int cx_ = 0, cz_ = 0;
+        int hx_ = 0, hz_ = 0;
+        int load_radius_ = -1;
         boost::shared_mutex lock_;
     } world_state_;
 
-    DoubleBufferedSet<ChunkId_t> finalization_queue_;
+    // the loader thread sleeps until there is something to do
+    boost::condition_variable wake_;
+    boost::mutex wake_lock_;
+    bool woken_ = false;
+
+    // called from any thread when there is new work for the loader
+    void wake();
+
+    // ticks whenever woken, no faster than config::kLoaderMaxTickRate, until shutdown
+    void run();
+
+    // loader thread, once it has stopped ticking so nothing unloaded is requested again
+    void save_and_stop();
+
+    // pushed to by workers, chunks are deduplicated by their finalization_queued flag
+    MpscQueue<ChunkId_t> finalization_queue_;
+
+    // reused each tick
+    std::vector<ChunkId_t> pending_finalization_, finalization_batch_;
+
+    // meshes built by the pool, waiting to be swapped in
+    struct MeshResult {
+        ChunkId_t chunk_id_;
+        uint64_t ticket_;
+        ChunkMeshRaw *mesh_;
+        size_t size_;
+    };
+    MpscQueue<MeshResult> mesh_results_;
+    std::vector<MeshResult> mesh_batch_;
+    uint64_t next_mesh_ticket_ = 1;
+
+    // centre as of the current tick, pool tasks are prioritised by distance from it
+    ChunkId_t last_centre_ = kChunkIdInit;
 
-    bool flush_cache_;
+    Priority chunk_priority(ChunkId_t chunk_id) const;
 
     boost::posix_time::ptime unload_barrier_;
 
-    boost::unordered_set<ChunkId_t> to_unload_;
-    boost::unordered_set<ChunkId_t> per_frame_chunks_;
+    // generation tasks that can still be cancelled, removed once finalized
+    boost::unordered_map<ChunkId_t, CancellationTokenPtr> generating_;
 
-    DynamicObjectPool<ChunkMeshRaw> mesh_pool_;
-    DynamicObjectPool<Chunk> chunk_pool_;
+    // requested this tick, posted together as regions of config::kGenerationBatchSize chunks square
+    struct PendingGeneration {
+        Chunk *chunk_;
+        CancellationTokenPtr token_;
+        Priority priority_;
+    };
+    std::vector<PendingGeneration> pending_generation_;
+
+    // requested this tick and in the pack, decoded by a task each
+    std::vector<PendingGeneration> pending_unpack_;
+
+    // range that has been requested so far, compared with the new one each tick
+    LoadRange loaded_range_;
+
+    // ahead of the load range in the direction of travel, generated at low priority straight into the cache
+    LoadRange prefetch_range_;
+
+    // chunks whose generation failed, pushed by workers to be unloaded and retried
+    MpscQueue<ChunkId_t> generation_failures_;
 
-    void tick();
+    // meshes are emptied rather than freed so the next build reuses their buffer, which build_mesh has
+    // already trimmed to the last mesh plus slack
+    struct RecycleMesh {
+        inline void operator()(ChunkMeshRaw &mesh) const { mesh.clear(); }
+    };
+
+    // used from both the loader and workers
+    ConcurrentObjectPool<ChunkMeshRaw, RecycleMesh> mesh_pool_;
+    ConcurrentObjectPool<Chunk> chunk_pool_;
+
+    // returns true if there is still work left that no event will wake us for
+    bool tick();
 
     ChunkState get_chunk(ChunkId_t chunk_id, Chunk **chunk_out = nullptr);
 
@@ -84,15 +202,53 @@ private:
     /**
      * Will either load from disk, load from chunk cache or generate from scratch
      * Posts request and does not block
+     * @param prefetch If outside the load range, generated behind everything in range and cached when done
+     */
+    void request_chunk(ChunkId_t chunk_id, bool prefetch = false);
+
+    // posts an unpack task per pack chunk and a generation task per region of chunks requested this tick
+    void post_generation();
+
+    // unloads chunks that failed to generate, and requests them again if still in range
+    void retry_failed_generation();
+
+    // queues generation of chunks that could not be loaded from disk
+    void generate_store_misses();
+
+    // requests chunks entering the prefetch range and cancels those leaving it
+    void update_prefetch(const LoadRange &range, const LoadRange &prefetch);
+
+    /**
+     * Posts a mesh build of a snapshot of the chunk's current terrain, so merges can continue
+     * on the live terrain. The current mesh is rendered until the result is applied
      */
-    void request_chunk(ChunkId_t chunk_id);
+    void request_mesh(Chunk *chunk);
 
-    // unload right now
+    // swaps in finished meshes and promotes their chunks to renderable
+    void apply_meshes();
+
+    // unloads or cancels a chunk no longer in range
+    void leave_range(ChunkId_t chunk_id);
+
+    // unload right now, into the cache if allowed
     void unload_chunk(Chunk *chunk, bool allow_cache = true);
 
-    bool should_unload(ChunkId_t chunk_id);
+    // deferred until the render thread can no longer see it
+    void delete_chunk(Chunk *chunk);
+
+    // queues its gpu buffers for deletion on the render thread and stops counting them, only once the render
+    // thread can no longer see it
+    void release_gpu(Chunk *chunk);
+
+    // saved first if there is a store and it is dirty, it must have terrain
+    void evict_chunk(Chunk *chunk);
+
+    // accounts for chunks and the cache, and applies the governor's limits
+    // returns the radius to load within
+    int govern_memory(int requested_radius);
 
-    void flush_cache_wrt_distance();
+    // publishes a new render snapshot if anything changed, and frees what is no longer visible
+    void publish_renderables();
 
     void really_unload_all_chunks();
 
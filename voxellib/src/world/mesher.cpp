@@ -0,0 +1,180 @@
+#include <bitset>
+#include <cassert>
+#include "mesher.h"
+
+typedef ChunkTerrain::BlockCoord BlockCoord;
+
+/**
+ * Emits the 6 vertices of a face covering extent blocks from block_pos
+ *
+ * @param extent Number of blocks covered along each axis, 1 along the face normal
+ */
+static void emit_face(ChunkMeshRaw &mesh, Face face, BlockType type,
+                      const BlockCoord &block_pos, const BlockCoord &extent) {
+    const int stride = 6 * 3; // 6 vertices * 3 floats per face
+    const float *verts = kBlockVertices + (stride * (int) face);
+
+    for (int v = 0; v < 6; ++v) {
+        // corner in chunk space, far corners are stretched over the extent
+        unsigned int corner[3];
+        for (int j = 0; j < 3; ++j)
+            corner[j] = block_pos[j] + (verts[v * 3 + j] > 0 ? extent[j] : 0);
+
+        mesh.push_back(pack_vertex(corner[0], corner[1], corner[2], face, type));
+        assert(mesh.size() <= kChunkMeshSize);
+    }
+}
+
+size_t mesh_naive(const ChunkTerrain &terrain, ChunkMeshRaw &mesh_out) {
+    const BlockCoord unit = {1, 1, 1};
+
+    BlockCoord block_pos;
+    mesh_out.clear();
+
+    for (int block_idx = 0; block_idx < kBlocksPerChunk; ++block_idx) {
+        const Block &block = terrain[block_idx];
+        // cull if totally occluded
+        if (block.face_visibility_.invisible())
+            continue;
+
+        // cull air blocks
+        if (block.type_ == BlockType::kAir)
+            continue;
+
+        terrain.expand(block_idx, block_pos);
+
+        for (Face face : kFaces) {
+            // cull face if not visible
+            if (!block.face_visibility_.visible(face))
+                continue;
+
+            emit_face(mesh_out, face, block.type_, block_pos, unit);
+        }
+    }
+
+    return mesh_out.size();
+}
+
+// {normal, u, v} axes for each face, as indices into x,y,z
+static const size_t kFaceAxes[kFaceCount][3] = {
+        {0, 1, 2}, // front: -x
+        {2, 0, 1}, // left: -z
+        {2, 0, 1}, // right: +z
+        {1, 0, 2}, // top: +y
+        {1, 0, 2}, // bottom: -y
+        {0, 1, 2}, // back: +x
+};
+
+static const size_t kChunkDims[3] = {kChunkWidth, kChunkHeight, kChunkDepth};
+
+// visible faces of a single direction, laid out as [normal][u][v]
+struct FaceSlices {
+    // kAir where there is no visible face
+    std::array<BlockType, kBlocksPerChunk> types;
+
+    // slices along the normal with at least one visible face
+    std::bitset<kChunkHeight> occupied;
+};
+
+size_t mesh_greedy(const ChunkTerrain &terrain, ChunkMeshRaw &mesh_out) {
+    // merging consumes every face it is given, so these are all kAir again on return
+    static thread_local std::array<FaceSlices, kFaceCount> all_slices{};
+
+    size_t strides[kFaceCount][3];
+    for (Face face : kFaces) {
+        const size_t *axes = kFaceAxes[face];
+        strides[face][axes[2]] = 1;
+        strides[face][axes[1]] = kChunkDims[axes[2]];
+        strides[face][axes[0]] = kChunkDims[axes[2]] * kChunkDims[axes[1]];
+        all_slices[face].occupied.reset();
+    }
+
+    // single pass to gather visible faces
+    BlockCoord pos;
+    for (int block_idx = 0; block_idx < kBlocksPerChunk; ++block_idx) {
+        const Block &block = terrain[block_idx];
+        if (block.face_visibility_.invisible() || block.type_ == BlockType::kAir)
+            continue;
+
+        terrain.expand(block_idx, pos);
+        for (Face face : kFaces) {
+            if (!block.face_visibility_.visible(face))
+                continue;
+
+            const size_t *stride = strides[face];
+            all_slices[face].types[pos[0] * stride[0] + pos[1] * stride[1] + pos[2] * stride[2]] = block.type_;
+            all_slices[face].occupied.set(pos[kFaceAxes[face][0]]);
+        }
+    }
+
+    mesh_out.clear();
+
+    for (Face face : kFaces) {
+        FaceSlices &slices = all_slices[face];
+        if (slices.occupied.none())
+            continue;
+
+        const size_t n_axis = kFaceAxes[face][0];
+        const size_t u_axis = kFaceAxes[face][1];
+        const size_t v_axis = kFaceAxes[face][2];
+        const size_t n_dim = kChunkDims[n_axis];
+        const size_t u_dim = kChunkDims[u_axis];
+        const size_t v_dim = kChunkDims[v_axis];
+
+        for (size_t n = 0; n < n_dim; ++n) {
+            if (!slices.occupied[n])
+                continue;
+
+            BlockType *slice = &slices.types[n * u_dim * v_dim];
+
+            // merge into maximal rectangles
+            for (size_t u = 0; u < u_dim; ++u) {
+                for (size_t v = 0; v < v_dim;) {
+                    BlockType type = slice[u * v_dim + v];
+                    if (type == BlockType::kAir) {
+                        ++v;
+                        continue;
+                    }
+
+                    // grow along v
+                    size_t width = 1;
+                    while (v + width < v_dim && slice[u * v_dim + v + width] == type)
+                        ++width;
+
+                    // grow along u while the whole row matches
+                    size_t height = 1;
+                    for (; u + height < u_dim; ++height) {
+                        const BlockType *row = &slice[(u + height) * v_dim + v];
+                        bool row_matches = true;
+                        for (size_t w = 0; w < width; ++w) {
+                            if (row[w] != type) {
+                                row_matches = false;
+                                break;
+                            }
+                        }
+                        if (!row_matches)
+                            break;
+                    }
+
+                    // consume
+                    for (size_t h = 0; h < height; ++h)
+                        for (size_t w = 0; w < width; ++w)
+                            slice[(u + h) * v_dim + v + w] = BlockType::kAir;
+
+                    BlockCoord origin, extent;
+                    origin[n_axis] = n;
+                    origin[u_axis] = u;
+                    origin[v_axis] = v;
+                    extent[n_axis] = 1;
+                    extent[u_axis] = height;
+                    extent[v_axis] = width;
+                    emit_face(mesh_out, face, type, origin, extent);
+
+                    v += width;
+                }
+            }
+        }
+    }
+
+    return mesh_out.size();
+}
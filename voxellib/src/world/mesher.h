@@ -0,0 +1,24 @@
+#ifndef VOXELS_MESHER_H
+#define VOXELS_MESHER_H
+
+#include "chunk.h"
+#include "terrain.h"
+
+/**
+ * One quad per visible block face
+ *
+ * @param mesh_out Cleared and grown as needed
+ * @return Number of words written to mesh_out
+ */
+size_t mesh_naive(const ChunkTerrain &terrain, ChunkMeshRaw &mesh_out);
+
+/**
+ * Merges coplanar adjacent faces of the same block type into maximal rectangles,
+ * per slice and per face direction
+ *
+ * @param mesh_out Cleared and grown as needed
+ * @return Number of words written to mesh_out
+ */
+size_t mesh_greedy(const ChunkTerrain &terrain, ChunkMeshRaw &mesh_out);
+
+#endif
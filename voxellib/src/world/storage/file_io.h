@@ -0,0 +1,42 @@
+#ifndef VOXELS_FILE_IO_H
+#define VOXELS_FILE_IO_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+
+// pread/pwrite until done, they may be short
+inline bool read_fully(int fd, void *buf, size_t len, uint64_t offset) {
+    auto *p = static_cast<uint8_t *>(buf);
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+inline bool write_fully(int fd, const void *buf, size_t len, uint64_t offset) {
+    auto *p = static_cast<const uint8_t *>(buf);
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "util.h"
+#include "file_io.h"
+#include "record.h"
+#include "pack.h"
+
+constexpr uint32_t WorldPack::kVersion;
+
+static const char kMagic[4] = {'V', 'X', 'P', 'K'};
+
+WorldPack::~WorldPack() {
+    close();
+}
+
+void WorldPack::close() {
+    if (data_ != nullptr)
+        munmap(const_cast<uint8_t *>(data_), size_);
+
+    data_ = nullptr;
+    size_ = 0;
+    index_ = nullptr;
+    count_ = 0;
+    seed_ = 0;
+    generator_ = 0;
+}
+
+int WorldPack::open(const std::string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_F(ERROR, "failed to open world pack %s: %s", path.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        LOG_F(ERROR, "world pack %s is too small or can't be read", path.c_str());
+        ::close(fd);
+        return kErrorFormat;
+    }
+
+    size_t size = st.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        LOG_F(ERROR, "failed to map world pack %s: %s", path.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    data_ = static_cast<const uint8_t *>(data);
+    size_ = size;
+
+    Header header;
+    memcpy(&header, data_, sizeof(header));
+    if (memcmp(header.magic_, kMagic, sizeof(kMagic)) != 0 || header.version_ != kVersion ||
+        header.index_offset_ % alignof(Entry) != 0 || header.index_offset_ > size_ ||
+        header.count_ > (size_ - header.index_offset_) / sizeof(Entry)) {
+        LOG_F(ERROR, "world pack %s has an unsupported header (version %u)", path.c_str(), header.version_);
+        close();
+        return kErrorFormat;
+    }
+
+    index_ = reinterpret_cast<const Entry *>(data_ + header.index_offset_);
+    count_ = header.count_;
+    seed_ = header.seed_;
+    generator_ = header.generator_;
+    return kErrorSuccess;
+}
+
+const WorldPack::Entry *WorldPack::find(ChunkId_t chunk_id) const {
+    const Entry *end = index_ + count_;
+    const Entry *e = std::lower_bound(index_, end, chunk_id,
+                                      [](const Entry &a, ChunkId_t id) { return a.chunk_id_ < id; });
+    return e != end && e->chunk_id_ == chunk_id ? e : nullptr;
+}
+
+bool WorldPack::contains(ChunkId_t chunk_id) const {
+    return find(chunk_id) != nullptr;
+}
+
+int WorldPack::load(Chunk *chunk) const {
+    const Entry *e = find(chunk->id());
+    if (e == nullptr || e->offset_ > size_ || e->length_ > size_ - e->offset_)
+        return kErrorFormat;
+
+    int ret = ChunkRecord::decode(data_ + e->offset_, e->length_, chunk->terrain_);
+    if (ret != kErrorSuccess)
+        chunk->terrain_ = ChunkTerrain();
+    return ret;
+}
+
+WorldPackWriter::~WorldPackWriter() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        unlink(temp_path_.c_str());
+    }
+}
+
+int WorldPackWriter::open(const std::string &path, int seed, uint32_t generator) {
+    path_ = path;
+    temp_path_ = path + ".tmp";
+    seed_ = seed;
+    generator_ = generator;
+
+    fd_ = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        LOG_F(ERROR, "failed to create world pack %s: %s", temp_path_.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    return kErrorSuccess;
+}
+
+int WorldPackWriter::add(ChunkId_t chunk_id, const uint8_t *record, size_t size) {
+    if (!write_fully(fd_, record, size, end_)) {
+        LOG_F(ERROR, "failed to write chunk %s to world pack: %s", ChunkId_str(chunk_id).c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    index_.push_back({chunk_id, end_, static_cast<uint32_t>(size), 0});
+    end_ += size;
+    return kErrorSuccess;
+}
+
+int WorldPackWriter::add(const Chunk *chunk) {
+    ChunkRecord::encode(chunk->terrain(), buffer_);
+    return add(chunk->id(), buffer_.data(), buffer_.size());
+}
+
+int WorldPackWriter::finish() {
+    std::sort(index_.begin(), index_.end(), [](const WorldPack::Entry &a, const WorldPack::Entry &b) {
+        return a.chunk_id_ < b.chunk_id_;
+    });
+
+    auto duplicate = std::adjacent_find(index_.begin(), index_.end(), [](const WorldPack::Entry &a,
+                                                                         const WorldPack::Entry &b) {
+        return a.chunk_id_ == b.chunk_id_;
+    });
+    if (duplicate != index_.end()) {
+        LOG_F(ERROR, "chunk %s was added to world pack %s twice", ChunkId_str(duplicate->chunk_id_).c_str(),
+              path_.c_str());
+        return kErrorFormat;
+    }
+
+    WorldPack::Header header{};
+    memcpy(header.magic_, kMagic, sizeof(kMagic));
+    header.version_ = WorldPack::kVersion;
+    header.count_ = index_.size();
+    header.seed_ = seed_;
+    header.generator_ = generator_;
+
+    // aligned, the index is read in place
+    header.index_offset_ = (end_ + alignof(WorldPack::Entry) - 1) / alignof(WorldPack::Entry) *
+                           alignof(WorldPack::Entry);
+
+    if (!write_fully(fd_, index_.data(), index_.size() * sizeof(WorldPack::Entry), header.index_offset_) ||
+        !write_fully(fd_, &header, sizeof(header), 0) || fsync(fd_) != 0) {
+        LOG_F(ERROR, "failed to finish world pack %s: %s", temp_path_.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+
+    if (rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        LOG_F(ERROR, "failed to move world pack into place at %s: %s", path_.c_str(), strerror(errno));
+        unlink(temp_path_.c_str());
+        return kErrorIo;
+    }
+
+    LOG_F(INFO, "wrote %zu chunks to world pack %s", index_.size(), path_.c_str());
+    return kErrorSuccess;
+}
@@ -0,0 +1,119 @@
+#ifndef VOXELS_PACK_H
+#define VOXELS_PACK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "world/chunk.h"
+
+/**
+ * Immutable file of pre-baked chunks, e.g. spawn regions, memory mapped read only so chunks are decoded
+ * straight out of the page cache with no copies or syscalls.
+ *
+ * A fixed header, which records the seed and generator the chunks were made with, is followed by ChunkRecord
+ * payloads back to back, then an index of every chunk sorted by id for binary search. Native byte order
+ */
+class WorldPack {
+public:
+    static constexpr uint32_t kVersion = 1;
+
+    WorldPack() = default;
+
+    WorldPack(const WorldPack &) = delete;
+
+    WorldPack &operator=(const WorldPack &) = delete;
+
+    ~WorldPack();
+
+    // maps the whole file, only the header and index bounds are checked
+    int open(const std::string &path);
+
+    void close();
+
+    bool contains(ChunkId_t chunk_id) const;
+
+    /**
+     * Decodes the chunk's terrain straight from the mapping, any thread. Left empty on failure so it can be
+     * generated instead
+     * @return kErrorFormat if the chunk is not in the pack or its record is bad
+     */
+    int load(Chunk *chunk) const;
+
+    // chunks in the pack
+    inline size_t size() const { return count_; }
+
+    // what the chunks were generated with, they only match generated chunks if both are the same
+    inline int seed() const { return seed_; }
+
+    inline uint32_t generator() const { return generator_; }
+
+private:
+    struct Header {
+        char magic_[4];
+        uint32_t version_;
+        uint64_t count_;
+        uint64_t index_offset_;
+        int32_t seed_;
+        uint32_t generator_;
+    };
+
+    struct Entry {
+        ChunkId_t chunk_id_;
+        uint64_t offset_;
+        uint32_t length_;
+        uint32_t reserved_;
+    };
+
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+    const Entry *index_ = nullptr;
+    size_t count_ = 0;
+
+    int seed_ = 0;
+    uint32_t generator_ = 0;
+
+    // null if not in the pack
+    const Entry *find(ChunkId_t chunk_id) const;
+
+    friend class WorldPackWriter;
+};
+
+/**
+ * Builds a pack in a temporary file next to the destination, which only replaces it once finished.
+ * Payloads are streamed to disk as they are added, only the index is kept in memory
+ */
+class WorldPackWriter {
+public:
+    WorldPackWriter() = default;
+
+    WorldPackWriter(const WorldPackWriter &) = delete;
+
+    WorldPackWriter &operator=(const WorldPackWriter &) = delete;
+
+    // the temporary file is removed if not finished
+    ~WorldPackWriter();
+
+    // seed and generator are recorded in the header, as whatever the chunks added are generated with
+    int open(const std::string &path, int seed, uint32_t generator);
+
+    // a ChunkRecord, each chunk may only be added once
+    int add(ChunkId_t chunk_id, const uint8_t *record, size_t size);
+
+    int add(const Chunk *chunk);
+
+    // writes the index and header then moves the pack into place
+    int finish();
+
+private:
+    std::string path_, temp_path_;
+    int fd_ = -1;
+    int seed_ = 0;
+    uint32_t generator_ = 0;
+    uint64_t end_ = sizeof(WorldPack::Header);
+    std::vector<WorldPack::Entry> index_;
+    std::vector<uint8_t> buffer_;
+};
+
+#endif
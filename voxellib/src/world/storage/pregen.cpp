@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "config.h"
+#include "error.h"
+#include "util.h"
+#include "threadpool.h"
+#include "world/generation/generator.h"
+#include "pack.h"
+#include "pregen.h"
+#include "region.h"
+
+// encoded chunks the store may hold before workers wait for it to catch up
+static const size_t kMaxPendingSaves = 1024;
+
+// chunk coords relative to the rectangle's min corner, laid out x major
+static inline size_t rect_index(const PregenOptions &o, int x, int z) {
+    return static_cast<size_t>(x - o.min_x_) * (o.max_z_ - o.min_z_ + 1) + (z - o.min_z_);
+}
+
+// read straight from the region files, only while no store has them open
+template<typename F>
+static void for_each_stored(const PregenOptions &o, F &&visit) {
+    int min_rx, min_rz, max_rx, max_rz;
+    RegionFile::region_of(ChunkId(o.min_x_, o.min_z_), min_rx, min_rz);
+    RegionFile::region_of(ChunkId(o.max_x_, o.max_z_), max_rx, max_rz);
+
+    for (int rx = min_rx; rx <= max_rx; ++rx) {
+        for (int rz = min_rz; rz <= max_rz; ++rz) {
+            RegionFile file;
+            if (file.open(o.directory_ + "/" + RegionFile::file_name(rx, rz), false) != kErrorSuccess)
+                continue;
+
+            const int size = RegionFile::kSize;
+            int x0 = std::max(o.min_x_, rx * size), x1 = std::min(o.max_x_, (rx + 1) * size - 1);
+            int z0 = std::max(o.min_z_, rz * size), z1 = std::min(o.max_z_, (rz + 1) * size - 1);
+            for (int x = x0; x <= x1; ++x) {
+                for (int z = z0; z <= z1; ++z) {
+                    if (file.contains(ChunkId(x, z)))
+                        visit(file, x, z);
+                }
+            }
+        }
+    }
+}
+
+static size_t find_stored(const PregenOptions &o, std::vector<bool> &stored_out) {
+    size_t count = 0;
+    for_each_stored(o, [&](const RegionFile &, int x, int z) {
+        stored_out[rect_index(o, x, z)] = true;
+        count++;
+    });
+    return count;
+}
+
+int pregenerate(const PregenOptions &options, const GeneratorFactory &new_generator,
+                PregenProgress &progress_out, const PregenProgressCallback &progress) {
+    const PregenOptions &o = options;
+    const int n = std::max(o.batch_size_, 1);
+    auto start = std::chrono::steady_clock::now();
+
+    progress_out = PregenProgress();
+    if (o.min_x_ > o.max_x_ || o.min_z_ > o.max_z_)
+        return kErrorSuccess;
+
+    progress_out.total_ = static_cast<size_t>(o.max_x_ - o.min_x_ + 1) * (o.max_z_ - o.min_z_ + 1);
+    std::vector<bool> stored(progress_out.total_, false);
+    progress_out.skipped_ = find_stored(o, stored);
+
+    std::atomic<size_t> generated{0}, failed{0}, tasks_done{0};
+    std::atomic_int error{kErrorSuccess};
+    size_t tasks = 0;
+
+    // generators may not be thread safe, so each is only lent to one task at a time
+    std::vector<std::unique_ptr<IGenerator>> generators;
+    std::vector<IGenerator *> idle_generators;
+    boost::mutex generators_lock;
+
+    auto update = [&]() {
+        progress_out.generated_ = generated;
+        progress_out.failed_ = failed;
+        progress_out.seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (progress)
+            progress(progress_out);
+    };
+
+    {
+        RegionStore store(o.directory_, [](Chunk *) {}, [](ChunkId_t, const CancellationTokenPtr &) {});
+        ThreadPool pool(o.threads_, config::kTerrainScheduling);
+
+        for (int rx = floor_to_multiple(o.min_x_, n); rx <= o.max_x_; rx += n) {
+            for (int rz = floor_to_multiple(o.min_z_, n); rz <= o.max_z_; rz += n) {
+                // chunk (-1, -1) is kChunkIdInit, so no sentinel id
+                std::vector<bool> wanted(n * n, false);
+                bool any = false;
+                for (int i = 0; i < n * n; ++i) {
+                    int x = rx + i / n, z = rz + i % n;
+                    if (x < o.min_x_ || x > o.max_x_ || z < o.min_z_ || z > o.max_z_ || stored[rect_index(o, x, z)])
+                        continue;
+
+                    wanted[i] = true;
+                    any = true;
+                }
+
+                if (!any)
+                    continue;
+
+                pool.post_batch([&, rx, rz, wanted = std::move(wanted)]() {
+                    IGenerator *gen;
+                    {
+                        boost::lock_guard<boost::mutex> lock(generators_lock);
+                        if (idle_generators.empty()) {
+                            generators.emplace_back(new_generator());
+                            idle_generators.push_back(generators.back().get());
+                        }
+                        gen = idle_generators.back();
+                        idle_generators.pop_back();
+                    }
+
+                    std::vector<Chunk *> chunks(n * n, nullptr);
+                    for (int i = 0; i < n * n; ++i) {
+                        if (wanted[i])
+                            chunks[i] = new Chunk(ChunkId(rx + i / n, rz + i % n), nullptr);
+                    }
+
+                    std::vector<int> results(n * n, kErrorSuccess);
+                    gen->generate_region(ChunkId(rx, rz), n, o.seed_, chunks.data(), results.data());
+                    {
+                        boost::lock_guard<boost::mutex> lock(generators_lock);
+                        idle_generators.push_back(gen);
+                    }
+
+                    for (int i = 0; i < n * n; ++i) {
+                        Chunk *chunk = chunks[i];
+                        if (chunk == nullptr)
+                            continue;
+
+                        if (results[i] != kErrorSuccess) {
+                            LOG_F(WARNING, "failed to generate chunk %s with seed %d: %d", CHUNKSTR(chunk), o.seed_,
+                                  results[i]);
+                            error = results[i];
+                            failed++;
+                            delete chunk;
+                            chunks[i] = nullptr;
+                            continue;
+                        }
+
+                        chunk->post_terrain_update();
+                    }
+
+                    // borders with other tasks are merged by the loader once loaded
+                    Chunk::merge_region(chunks.data(), n);
+
+                    // bounds memory if generating outpaces the disk
+                    while (store.pending() > kMaxPendingSaves)
+                        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+
+                    for (Chunk *chunk : chunks) {
+                        if (chunk == nullptr)
+                            continue;
+
+                        store.save(chunk);
+                        delete chunk;
+                        generated++;
+                    }
+
+                    tasks_done++;
+                });
+                tasks++;
+            }
+        }
+        pool.post_batch_end();
+
+        auto next_report = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (tasks_done < tasks) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+            if (std::chrono::steady_clock::now() >= next_report) {
+                update();
+                next_report += std::chrono::seconds(1);
+            }
+        }
+
+        store.flush();
+    }
+
+    update();
+    return error;
+}
+
+int pack_stored(const PregenOptions &options, const std::string &path, size_t &packed_out) {
+    packed_out = 0;
+    WorldPackWriter writer;
+    int ret = writer.open(path, options.seed_, options.generator_);
+    if (ret != kErrorSuccess)
+        return ret;
+
+    // records are copied as they are, nothing is decoded
+    std::vector<uint8_t> record;
+    for_each_stored(options, [&](const RegionFile &file, int x, int z) {
+        if (ret != kErrorSuccess)
+            return;
+
+        ChunkId_t c = ChunkId(x, z);
+        ret = file.read(c, record);
+        if (ret == kErrorSuccess)
+            ret = writer.add(c, record.data(), record.size());
+        if (ret == kErrorSuccess)
+            packed_out++;
+    });
+
+    return ret == kErrorSuccess ? writer.finish() : ret;
+}
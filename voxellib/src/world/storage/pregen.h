@@ -0,0 +1,66 @@
+#ifndef VOXELS_PREGEN_H
+#define VOXELS_PREGEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class IGenerator;
+
+struct PregenOptions {
+    // inclusive chunk coords of the rectangle
+    int min_x_, min_z_, max_x_, max_z_;
+
+    int seed_;
+
+    // as config::GeneratorType, only recorded in packs, chunks are generated by the factory
+    uint32_t generator_;
+
+    // region files are saved here
+    std::string directory_;
+
+    unsigned int threads_;
+
+    // chunks square generated together by each task, aligned to multiples of it
+    int batch_size_;
+};
+
+struct PregenProgress {
+    // chunks in the rectangle
+    size_t total_ = 0;
+
+    // already stored before starting, and skipped
+    size_t skipped_ = 0;
+
+    size_t generated_ = 0;
+    size_t failed_ = 0;
+    double seconds_ = 0;
+
+    inline double chunks_per_second() const { return seconds_ > 0 ? generated_ / seconds_ : 0; }
+};
+
+// called on the calling thread
+typedef std::function<void(const PregenProgress &progress)> PregenProgressCallback;
+
+// called from workers, each generator is only used by one task at a time
+typedef std::function<IGenerator *()> GeneratorFactory;
+
+/**
+ * Generates, post processes and saves every chunk in a rectangle on a thread pool, blocking until all of
+ * it is on disk, so e.g. spawn regions can be baked before players ever get there.
+ * Chunks already stored are skipped, so an interrupted run is resumed by running it again
+ *
+ * @param progress Called about once a second and when done
+ * @return kErrorSuccess if every chunk is now stored, otherwise the error of a failed chunk
+ */
+int pregenerate(const PregenOptions &options, const GeneratorFactory &new_generator,
+                PregenProgress &progress_out, const PregenProgressCallback &progress = nullptr);
+
+/**
+ * Writes every chunk of the rectangle already stored under options.directory_ to a WorldPack at path,
+ * replacing it. Chunks that are not stored are left out of the pack and generated by the game as usual
+ */
+int pack_stored(const PregenOptions &options, const std::string &path, size_t &packed_out);
+
+#endif
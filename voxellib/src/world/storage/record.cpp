@@ -0,0 +1,73 @@
+#include <cstring>
+
+#include "error.h"
+#include "world/terrain_codec.h"
+#include "record.h"
+
+constexpr uint16_t ChunkRecord::kVersion;
+
+static const char kMagic[4] = {'V', 'X', 'C', 'K'};
+
+void ChunkRecord::encode(const ChunkTerrain &terrain, std::vector<uint8_t> &out) {
+    static_assert(sizeof(ChunkTerrain::neighbour_opacity_) == kBordersSizeBytes,
+                  "border opacity must be fully serialised");
+
+    out.resize(sizeof(Header));
+    TerrainEncoder::encode(terrain, out);
+
+    Header header{};
+    memcpy(header.magic_, kMagic, sizeof(kMagic));
+    header.version_ = kVersion;
+    header.length_ = static_cast<uint32_t>(out.size() - sizeof(Header) + kTailLength);
+    memcpy(out.data(), &header, sizeof(header));
+
+    size_t tail = out.size();
+    out.resize(tail + kTailLength);
+    uint8_t *p = out.data() + tail;
+    auto append = [&p](const void *src, size_t len) {
+        memcpy(p, src, len);
+        p += len;
+    };
+
+    const auto &borders = terrain.neighbour_opacity_;
+    append(borders.back_.data(), sizeof(borders.back_));
+    append(borders.front_.data(), sizeof(borders.front_));
+    append(borders.left_.data(), sizeof(borders.left_));
+    append(borders.right_.data(), sizeof(borders.right_));
+    *p = static_cast<uint8_t>(terrain.merged_sides_.to_ulong());
+}
+
+int ChunkRecord::decode(const uint8_t *data, size_t size, ChunkTerrain &terrain_out) {
+    Header header;
+    if (size < sizeof(header))
+        return kErrorFormat;
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic_, kMagic, sizeof(kMagic)) != 0 || header.version_ != kVersion ||
+        size != sizeof(header) + header.length_ || header.length_ < kTailLength)
+        return kErrorFormat;
+
+    const uint8_t *p = data + sizeof(header);
+    size_t blocks_length = header.length_ - kTailLength;
+
+    int ret = TerrainDecoder::decode(p, blocks_length, terrain_out);
+    if (ret != kErrorSuccess)
+        return ret;
+
+    decode_tail(p + blocks_length, terrain_out);
+    return kErrorSuccess;
+}
+
+void ChunkRecord::decode_tail(const uint8_t *p, ChunkTerrain &terrain_out) {
+    auto consume = [&p](void *dst, size_t len) {
+        memcpy(dst, p, len);
+        p += len;
+    };
+
+    auto &borders = terrain_out.neighbour_opacity_;
+    consume(borders.back_.data(), sizeof(borders.back_));
+    consume(borders.front_.data(), sizeof(borders.front_));
+    consume(borders.left_.data(), sizeof(borders.left_));
+    consume(borders.right_.data(), sizeof(borders.right_));
+    terrain_out.merged_sides_ = *p;
+}
@@ -0,0 +1,48 @@
+#ifndef VOXELS_RECORD_H
+#define VOXELS_RECORD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "world/terrain.h"
+
+/**
+ * Serialised chunk terrain, including everything post_terrain_update and face merging derive from the
+ * block types: face masks, column and border opacity and which sides have been merged. A restored chunk
+ * is ready to be merged with newly loaded neighbours and meshed.
+ *
+ * A fixed header (magic, version, payload length) is followed by the sections in order:
+ *  - blocks with their face masks, encoded by TerrainEncoder. Column opacity is rebuilt as they are decoded
+ *  - border opacity, back, front, left then right edge columns
+ *  - merged sides, one byte with bit n set if side n has been merged
+ *
+ * Native byte order
+ */
+class ChunkRecord {
+public:
+    static constexpr uint16_t kVersion = 1;
+
+    static void encode(const ChunkTerrain &terrain, std::vector<uint8_t> &out);
+
+    // on error terrain_out is left in an unspecified state
+    static int decode(const uint8_t *data, size_t size, ChunkTerrain &terrain_out);
+
+private:
+    struct Header {
+        char magic_[4];
+        uint16_t version_;
+        uint16_t reserved_;
+        uint32_t length_;
+    };
+
+    static constexpr size_t kBordersSizeBytes =
+            (kChunkWidth + kChunkDepth) * 2 * sizeof(ChunkTerrain::ColumnMask);
+
+    // after the blocks
+    static constexpr size_t kTailLength = kBordersSizeBytes + 1;
+
+    // reads border opacity and merged sides
+    static void decode_tail(const uint8_t *p, ChunkTerrain &terrain_out);
+};
+
+#endif
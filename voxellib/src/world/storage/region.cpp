@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "util.h"
+#include "file_io.h"
+#include "record.h"
+#include "region.h"
+
+constexpr int RegionFile::kSize;
+constexpr size_t RegionStore::kMaxOpenRegions;
+
+static const char kMagic[4] = {'V', 'X', 'R', 'G'};
+static const char *kExtension = ".vxr";
+
+// mkdir -p
+static int ensure_directory(const std::string &path) {
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i != path.size() && path[i] != '/')
+            continue;
+
+        std::string prefix = path.substr(0, i);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_F(ERROR, "failed to create directory %s: %s", prefix.c_str(), strerror(errno));
+            return kErrorIo;
+        }
+    }
+
+    return kErrorSuccess;
+}
+
+RegionFile::~RegionFile() {
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+int RegionFile::open(const std::string &path, bool create) {
+    fd_ = ::open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd_ < 0) {
+        if (create || errno != ENOENT)
+            LOG_F(ERROR, "failed to open region %s: %s", path.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        LOG_F(ERROR, "failed to stat region %s: %s", path.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    // new file
+    if (st.st_size == 0) {
+        Header header{};
+        memcpy(header.magic_, kMagic, sizeof(kMagic));
+        header.version_ = kVersion;
+        header.size_ = kSize;
+
+        table_.fill({});
+        if (!write_fully(fd_, &header, sizeof(header), 0) ||
+            !write_fully(fd_, table_.data(), sizeof(table_), kTableOffset)) {
+            LOG_F(ERROR, "failed to initialise region %s: %s", path.c_str(), strerror(errno));
+            return kErrorIo;
+        }
+
+        end_ = kPayloadOffset;
+        return kErrorSuccess;
+    }
+
+    Header header;
+    if (!read_fully(fd_, &header, sizeof(header), 0) ||
+        !read_fully(fd_, table_.data(), sizeof(table_), kTableOffset)) {
+        LOG_F(ERROR, "failed to read region header %s: %s", path.c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    if (memcmp(header.magic_, kMagic, sizeof(kMagic)) != 0 || header.version_ != kVersion ||
+        header.size_ != kSize) {
+        LOG_F(ERROR, "region %s has an unsupported header (version %u, size %u)", path.c_str(),
+              header.version_, header.size_);
+        return kErrorFormat;
+    }
+
+    end_ = std::max<uint64_t>(static_cast<uint64_t>(st.st_size), kPayloadOffset);
+    return kErrorSuccess;
+}
+
+int RegionFile::read(ChunkId_t chunk_id, std::vector<uint8_t> &out) const {
+    out.clear();
+
+    const Entry &entry = table_[index_of(chunk_id)];
+    if (entry.length_ == 0)
+        return kErrorSuccess;
+
+    out.resize(entry.length_);
+    if (!read_fully(fd_, out.data(), entry.length_, entry.offset_)) {
+        LOG_F(ERROR, "failed to read chunk %s from region: %s", ChunkId_str(chunk_id).c_str(), strerror(errno));
+        out.clear();
+        return kErrorIo;
+    }
+
+    return kErrorSuccess;
+}
+
+int RegionFile::write(ChunkId_t chunk_id, const uint8_t *data, size_t size) {
+    int index = index_of(chunk_id);
+    Entry entry{end_, static_cast<uint32_t>(size), 0};
+
+    // payload first, so the table never points at a partial one
+    if (!write_fully(fd_, data, size, entry.offset_) ||
+        !write_fully(fd_, &entry, sizeof(entry), kTableOffset + index * sizeof(Entry))) {
+        LOG_F(ERROR, "failed to write chunk %s to region: %s", ChunkId_str(chunk_id).c_str(), strerror(errno));
+        return kErrorIo;
+    }
+
+    table_[index] = entry;
+    end_ += size;
+    return kErrorSuccess;
+}
+
+int RegionFile::write(const Write *writes, size_t n) {
+    std::vector<uint8_t> payloads;
+    auto table = table_;
+    for (size_t i = 0; i < n; ++i) {
+        const Write &w = writes[i];
+        table[index_of(w.chunk_id_)] = {end_ + payloads.size(), static_cast<uint32_t>(w.size_), 0};
+        payloads.insert(payloads.end(), w.data_, w.data_ + w.size_);
+    }
+
+    // payloads first, so the table never points at a partial one
+    if (!write_fully(fd_, payloads.data(), payloads.size(), end_) ||
+        !write_fully(fd_, table.data(), sizeof(table), kTableOffset)) {
+        LOG_F(ERROR, "failed to write %zu chunks to region: %s", n, strerror(errno));
+        return kErrorIo;
+    }
+
+    table_ = table;
+    end_ += payloads.size();
+    return kErrorSuccess;
+}
+
+bool RegionFile::contains(ChunkId_t chunk_id) const {
+    return table_[index_of(chunk_id)].length_ != 0;
+}
+
+void RegionFile::region_of(ChunkId_t chunk_id, int &rx, int &rz) {
+    int x, z;
+    ChunkId_deconstruct(chunk_id, x, z);
+
+    // arithmetic shift rounds towards negative infinity
+    rx = x >> kSizeShift;
+    rz = z >> kSizeShift;
+}
+
+int RegionFile::index_of(ChunkId_t chunk_id) {
+    int x, z;
+    ChunkId_deconstruct(chunk_id, x, z);
+    return (x & (kSize - 1)) * kSize + (z & (kSize - 1));
+}
+
+std::string RegionFile::file_name(int rx, int rz) {
+    return "r." + std::to_string(rx) + "." + std::to_string(rz) + kExtension;
+}
+
+RegionStore::RegionStore(std::string directory, LoadedCallback loaded, MissingCallback missing) :
+        directory_(std::move(directory)),
+        loaded_(std::move(loaded)),
+        missing_(std::move(missing)),
+        scratch_(new ChunkTerrain) {
+
+    ensure_directory(directory_);
+    thread_ = boost::thread([this]() { run(); });
+}
+
+RegionStore::~RegionStore() {
+    {
+        boost::lock_guard<boost::mutex> lock(lock_);
+        stop_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void RegionStore::load(Chunk *chunk, CancellationTokenPtr token) {
+    push({Request::kLoad, chunk->id(), chunk, std::move(token)});
+}
+
+void RegionStore::save(const Chunk *chunk) {
+    if (!chunk->dirty())
+        return;
+
+    // encoded on the caller, the I/O thread only writes
+    std::vector<uint8_t> data;
+    ChunkRecord::encode(chunk->terrain(), data);
+    {
+        boost::lock_guard<boost::mutex> lock(lock_);
+        saves_[chunk->id()] = std::move(data);
+    }
+    cond_.notify_one();
+}
+
+void RegionStore::discard_all() {
+    {
+        boost::lock_guard<boost::mutex> lock(lock_);
+        saves_.clear();
+        requests_.push_back({Request::kDiscard, kChunkIdInit, nullptr, nullptr});
+    }
+    cond_.notify_one();
+}
+
+void RegionStore::flush() {
+    boost::unique_lock<boost::mutex> lock(lock_);
+    while (busy_ || !requests_.empty() || !saves_.empty())
+        idle_cond_.wait(lock);
+}
+
+size_t RegionStore::pending() {
+    boost::lock_guard<boost::mutex> lock(lock_);
+    return requests_.size() + saves_.size();
+}
+
+void RegionStore::push(Request &&request) {
+    {
+        boost::lock_guard<boost::mutex> lock(lock_);
+        requests_.push_back(std::move(request));
+    }
+    cond_.notify_one();
+}
+
+void RegionStore::run() {
+    while (true) {
+        Request request;
+        bool have_request = false;
+        {
+            boost::unique_lock<boost::mutex> lock(lock_);
+            busy_ = false;
+            while (requests_.empty() && saves_.empty()) {
+                // drained before stopping, so nothing saved is lost
+                if (stop_)
+                    return;
+
+                idle_cond_.notify_all();
+                cond_.wait(lock);
+            }
+            busy_ = true;
+
+            // requests first, so a discard never deletes a later save
+            if (!requests_.empty()) {
+                request = std::move(requests_.front());
+                requests_.pop_front();
+                have_request = true;
+            } else {
+                for (auto &save : saves_)
+                    batch_.emplace_back(save.first, std::move(save.second));
+                saves_.clear();
+            }
+        }
+
+        if (have_request)
+            handle(request);
+        else
+            write_batch();
+    }
+}
+
+void RegionStore::handle(Request &request) {
+    switch (request.type_) {
+        case Request::kLoad: {
+            ChunkId_t c = request.chunk_id_;
+
+            // saved but not yet written
+            bool held = false;
+            {
+                boost::lock_guard<boost::mutex> lock(lock_);
+                auto it = saves_.find(c);
+                if (it != saves_.end()) {
+                    buffer_ = it->second;
+                    held = true;
+                }
+            }
+
+            if (!held) {
+                RegionFile *file = region(c, false);
+                if (file == nullptr || !file->contains(c) || file->read(c, buffer_) != kErrorSuccess) {
+                    missing_(c, request.token_);
+                    break;
+                }
+            }
+
+            int ret = ChunkRecord::decode(buffer_.data(), buffer_.size(), *scratch_);
+            if (ret != kErrorSuccess) {
+                LOG_F(WARNING, "failed to decode stored chunk %s, generating it instead: %d",
+                      ChunkId_str(c).c_str(), ret);
+                missing_(c, request.token_);
+                break;
+            }
+
+            // cancelled while queued, the chunk may already be gone
+            if (!request.token_->begin())
+                break;
+
+            Chunk *chunk = request.chunk_;
+            chunk->terrain_ = *scratch_;
+
+            DLOG_F(INFO, "loaded chunk %s from disk", CHUNKSTR(chunk));
+            loaded_(chunk);
+            break;
+        }
+
+        case Request::kDiscard: {
+            regions_.clear();
+
+            DIR *dir = opendir(directory_.c_str());
+            if (dir == nullptr)
+                break;
+
+            size_t ext_len = strlen(kExtension);
+            while (struct dirent *e = readdir(dir)) {
+                std::string name(e->d_name);
+                if (name.size() > ext_len && name.compare(name.size() - ext_len, ext_len, kExtension) == 0)
+                    unlink((directory_ + "/" + name).c_str());
+            }
+            closedir(dir);
+
+            LOG_F(INFO, "discarded all stored chunks in %s", directory_.c_str());
+            break;
+        }
+    }
+}
+
+void RegionStore::write_batch() {
+    auto region_less = [](const std::pair<ChunkId_t, std::vector<uint8_t>> &a,
+                          const std::pair<ChunkId_t, std::vector<uint8_t>> &b) {
+        int arx, arz, brx, brz;
+        RegionFile::region_of(a.first, arx, arz);
+        RegionFile::region_of(b.first, brx, brz);
+        return arx != brx ? arx < brx : arz < brz;
+    };
+    std::sort(batch_.begin(), batch_.end(), region_less);
+
+    for (auto begin = batch_.begin(); begin != batch_.end();) {
+        auto end = std::upper_bound(begin, batch_.end(), *begin, region_less);
+
+        region_writes_.clear();
+        for (auto it = begin; it != end; ++it)
+            region_writes_.push_back({it->first, it->second.data(), it->second.size()});
+
+        RegionFile *file = region(begin->first, true);
+        if (file != nullptr)
+            file->write(region_writes_.data(), region_writes_.size());
+
+        begin = end;
+    }
+
+    DLOG_F(INFO, "wrote %zu chunks to disk", batch_.size());
+    batch_.clear();
+}
+
+RegionFile *RegionStore::region(ChunkId_t chunk_id, bool create) {
+    int rx, rz;
+    RegionFile::region_of(chunk_id, rx, rz);
+
+    for (auto it = regions_.begin(); it != regions_.end(); ++it) {
+        if (it->rx_ == rx && it->rz_ == rz) {
+            regions_.splice(regions_.begin(), regions_, it);
+            return &regions_.front().file_;
+        }
+    }
+
+    if (regions_.size() >= kMaxOpenRegions)
+        regions_.pop_back();
+
+    regions_.emplace_front();
+    OpenRegion &region = regions_.front();
+    region.rx_ = rx;
+    region.rz_ = rz;
+
+    std::string path = directory_ + "/" + RegionFile::file_name(rx, rz);
+    if (region.file_.open(path, create) != kErrorSuccess) {
+        regions_.pop_front();
+        return nullptr;
+    }
+
+    return &region.file_;
+}
@@ -0,0 +1,205 @@
+#ifndef VOXELS_REGION_H
+#define VOXELS_REGION_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "threadpool.h"
+#include "world/chunk.h"
+
+/**
+ * A square of kSize*kSize chunks in one file. A fixed header and offset table is followed by chunk
+ * payloads, appended on every write so a crash mid write leaves the old payload in place.
+ * Space of overwritten payloads is not reclaimed. Native byte order
+ */
+class RegionFile {
+public:
+    static constexpr int kSizeShift = 5;
+    static constexpr int kSize = 1 << kSizeShift; // 32
+
+    static constexpr uint32_t kVersion = 1;
+
+    RegionFile() = default;
+
+    RegionFile(const RegionFile &) = delete;
+
+    RegionFile &operator=(const RegionFile &) = delete;
+
+    ~RegionFile();
+
+    /**
+     * @param create If false and the file does not exist, fails with kErrorIo and errno ENOENT
+     */
+    int open(const std::string &path, bool create);
+
+    /**
+     * @param chunk_id Must be within this region
+     * @param out Cleared if the chunk has not been written
+     */
+    int read(ChunkId_t chunk_id, std::vector<uint8_t> &out) const;
+
+    int write(ChunkId_t chunk_id, const uint8_t *data, size_t size);
+
+    struct Write {
+        ChunkId_t chunk_id_;
+        const uint8_t *data_;
+        size_t size_;
+    };
+
+    /**
+     * All payloads are appended in one go then the table is written once, so a batch costs two writes
+     * however many chunks it holds
+     * @param writes All within this region, a chunk written more than once keeps the last
+     */
+    int write(const Write *writes, size_t n);
+
+    bool contains(ChunkId_t chunk_id) const;
+
+    // region holding the chunk, in region coords
+    static void region_of(ChunkId_t chunk_id, int &rx, int &rz);
+
+    // index of the chunk in its region's offset table
+    static int index_of(ChunkId_t chunk_id);
+
+    // r.<rx>.<rz>.vxr
+    static std::string file_name(int rx, int rz);
+
+private:
+    struct Header {
+        char magic_[4];
+        uint32_t version_;
+        uint32_t size_;
+        uint32_t reserved_;
+    };
+
+    struct Entry {
+        uint64_t offset_;
+        uint32_t length_;
+        uint32_t reserved_;
+    };
+
+    static constexpr size_t kTableOffset = sizeof(Header);
+    static constexpr size_t kPayloadOffset = kTableOffset + sizeof(Entry) * kSize * kSize;
+
+    int fd_ = -1;
+    std::array<Entry, kSize * kSize> table_{};
+
+    // where the next payload is appended
+    uint64_t end_ = kPayloadOffset;
+};
+
+/**
+ * Chunks saved to region files under a directory. All file access is on a dedicated I/O thread so callers
+ * never wait on disk.
+ *
+ * Saves are write-behind: they are held in memory until the I/O thread is free, a chunk saved again before
+ * then replaces its earlier save, and each batch taken is written a region at a time. Loads and discards are
+ * handled in the order requested, before any held saves, and a load sees a held save as if it were written
+ */
+class RegionStore {
+public:
+    // I/O thread, terrain has been restored into the chunk ready to merge and mesh, see ChunkRecord
+    typedef std::function<void(Chunk *chunk)> LoadedCallback;
+
+    // I/O thread, the chunk is not stored and the chunk was not touched
+    typedef std::function<void(ChunkId_t chunk_id, const CancellationTokenPtr &token)> MissingCallback;
+
+    // regions kept open at once
+    static constexpr size_t kMaxOpenRegions = 16;
+
+    RegionStore(std::string directory, LoadedCallback loaded, MissingCallback missing);
+
+    // finishes all queued requests first
+    ~RegionStore();
+
+    /**
+     * Restores the chunk's terrain if stored, otherwise reports it missing.
+     * The chunk is only touched if token can still be begun, so it can be cancelled while queued
+     */
+    void load(Chunk *chunk, CancellationTokenPtr token);
+
+    /**
+     * Copies the chunk's terrain, so it can be freed as soon as this returns.
+     * Does nothing if the chunk is not dirty, as it is already stored as it is
+     */
+    void save(const Chunk *chunk);
+
+    // deletes every region file and drops saves not yet written, e.g. when the generator has changed
+    void discard_all();
+
+    // blocks until everything requested so far has been done and written
+    void flush();
+
+    // requests and saves queued and not yet done
+    size_t pending();
+
+private:
+    struct Request {
+        enum Type {
+            kLoad,
+            kDiscard,
+        } type_;
+
+        ChunkId_t chunk_id_;
+        Chunk *chunk_;
+        CancellationTokenPtr token_;
+    };
+
+    std::string directory_;
+    LoadedCallback loaded_;
+    MissingCallback missing_;
+
+    std::deque<Request> requests_;
+
+    // encoded chunks not yet taken by the I/O thread, at most one per chunk
+    boost::unordered_map<ChunkId_t, std::vector<uint8_t>> saves_;
+
+    boost::mutex lock_;
+    boost::condition_variable cond_;
+
+    // notified when the I/O thread runs out of work
+    boost::condition_variable idle_cond_;
+    bool busy_ = false;
+    bool stop_ = false;
+
+    // I/O thread only, most recently used at the front
+    struct OpenRegion {
+        int rx_, rz_;
+        RegionFile file_;
+    };
+    std::list<OpenRegion> regions_;
+    std::vector<uint8_t> buffer_;
+
+    // saves taken from saves_, sorted by region then written
+    std::vector<std::pair<ChunkId_t, std::vector<uint8_t>>> batch_;
+    std::vector<RegionFile::Write> region_writes_;
+
+    // decoded into before touching the chunk, so a bad payload can still be handed back for generation
+    std::unique_ptr<ChunkTerrain> scratch_;
+
+    boost::thread thread_;
+
+    void push(Request &&request);
+
+    void run();
+
+    void handle(Request &request);
+
+    // writes everything in batch_
+    void write_batch();
+
+    // null on error, or if it does not exist and create is false
+    RegionFile *region(ChunkId_t chunk_id, bool create);
+};
+
+#endif
@@ -16,147 +16,145 @@ ChunkNeighbour ChunkNeighbour::opposite() const {
 }
 
 Block &ChunkTerrain::operator[](unsigned int flat_index) {
-    return grid_[grid_.unflatten(flat_index)];
+    return grid_[static_cast<GridType::size_type>(flat_index)];
+}
+
+const Block &ChunkTerrain::operator[](unsigned int flat_index) const {
+    return grid_[static_cast<GridType::size_type>(flat_index)];
 }
 
 Block &ChunkTerrain::operator[](const GridType::ArrayCoord &coord) {
     return grid_[coord];
 }
 
-void ChunkTerrain::expand(unsigned int index, BlockCoord &out) {
-    GridType::ArrayCoord expanded = grid_.unflatten(index);
-    std::copy(expanded.cbegin(), expanded.cend(), out.begin());
+const Block &ChunkTerrain::operator[](const GridType::ArrayCoord &coord) const {
+    return grid_[coord];
 }
 
-void ChunkTerrain::update_face_visibility() {
-    BlockCoord pos;
-    for (int i = 0; i < kBlocksPerChunk; ++i) {
-        Block &b = (*this)[i];
-
-        FaceVisibility visibility = b.face_visibility_;
-
-        if (!BlockType_opaque(b.type_)) {
-            // fully visible because transparent
-            visibility.set_fully_visible();
-        } else {
-            expand(i, pos);
-
-            // check each face individually
-            BlockCoord offset_pos;
-            for (int j = 0; j < kFaceCount; ++j) {
-                offset_pos = pos; // reset
-                Face face = kFaces[j];
-                face_offset(face, offset_pos.data_);
-
-                // facing top/bottom of world, so this face is visible
-                if (offset_pos[1] < 0 || offset_pos[1] >= kChunkHeight) {
-                    visibility.set_face_visible(face, true);
-                    continue;
-                }
+void ChunkTerrain::set_type(const BlockCoord &coord, BlockType type) {
+    set_type(grid_.flatten(coord), type);
+}
 
-                // faces chunk boundary, will be updated later
-                if (offset_pos[0] < 0 || offset_pos[0] >= kChunkWidth ||
-                    offset_pos[2] < 0 || offset_pos[2] >= kChunkDepth) {
-                    visibility.set_face_visible(face, true);
-                    continue;
-                }
+void ChunkTerrain::set_type(unsigned int flat_index, BlockType type) {
+    grid_[static_cast<GridType::size_type>(flat_index)].type_ = type;
 
-                // inside this chunk, safe to get the block type (rather ugly...)
-                Block &offset_block = (*this)[offset_pos];
-                visibility.set_face_visible(face, !BlockType_opaque(offset_block.type_));
+    BlockCoord pos = grid_.unflatten(flat_index);
+    ColumnMask &col = opacity_[pos[0] * kChunkDepth + pos[2]];
+    ColumnMask bit = ColumnMask(1) << pos[1];
+    col = BlockType_opaque(type) ? (col | bit) : (col & ~bit);
+}
+
+void ChunkTerrain::rebuild_opacity() {
+    for (size_t x = 0; x < kChunkWidth; ++x) {
+        for (size_t z = 0; z < kChunkDepth; ++z) {
+            ColumnMask col = 0;
+            for (size_t y = 0; y < kChunkHeight; ++y) {
+                if (BlockType_opaque(grid_[{x, y, z}].type_))
+                    col |= ColumnMask(1) << y;
             }
+            opacity_[x * kChunkDepth + z] = col;
         }
-
-        b.face_visibility_ = visibility;
     }
+}
 
+void ChunkTerrain::expand(unsigned int index, BlockCoord &out) const {
+    GridType::ArrayCoord expanded = grid_.unflatten(index);
+    std::copy(expanded.cbegin(), expanded.cend(), out.begin());
 }
 
-void ChunkTerrain::populate_neighbour_opacity() {
-    // back: +x
-    for (size_t y = 0; y < kChunkHeight; ++y) {
-        for (size_t z = 0; z < kChunkDepth; ++z) {
-            const size_t x = kChunkWidth - 1;
-            Block &block = (*this)[{x, y, z}];
-            neighbour_opacity_.back_[{y, z}] = BlockType_opaque(block.type_);
-        }
-    }
+void ChunkTerrain::update_face_visibility() {
+    const ColumnMask kAll = ~ColumnMask(0);
 
-    // front: -x
-    for (size_t y = 0; y < kChunkHeight; ++y) {
+    for (size_t x = 0; x < kChunkWidth; ++x) {
         for (size_t z = 0; z < kChunkDepth; ++z) {
-            const size_t x = 0;
-            Block &block = (*this)[{x, y, z}];
-            neighbour_opacity_.front_[{y, z}] = BlockType_opaque(block.type_);
+            const ColumnMask col = column(x, z);
+
+            // faces on the chunk boundary are visible until merged with the neighbour later
+            const ColumnMask front = x > 0 ? column(x - 1, z) : 0;
+            const ColumnMask back = x < kChunkWidth - 1 ? column(x + 1, z) : 0;
+            const ColumnMask left = z > 0 ? column(x, z - 1) : 0;
+            const ColumnMask right = z < kChunkDepth - 1 ? column(x, z + 1) : 0;
+
+            // transparent blocks are fully visible
+            // top/bottom of the world shift in zeroes, so are always visible
+            const ColumnMask transparent = ~col;
+            ColumnMask faces[kFaceCount];
+            faces[kFront] = transparent | ~front;
+            faces[kLeft] = transparent | ~left;
+            faces[kRight] = transparent | ~right;
+            faces[kTop] = transparent | ~(col >> 1u);
+            faces[kBottom] = transparent | ~(col << 1u);
+            faces[kBack] = transparent | ~back;
+
+            ColumnMask all_visible = kAll, any_visible = 0;
+            for (ColumnMask f : faces) {
+                all_visible &= f;
+                any_visible |= f;
+            }
+
+            // scatter into blocks, which are strided by kChunkDepth along y
+            Block *block = &grid_[{x, 0, z}];
+            for (size_t y = 0; y < kChunkHeight; ++y, block += kChunkDepth) {
+                FaceVisibility::Mask mask;
+                if ((all_visible >> y) & 1u) {
+                    mask = FaceVisibility::kAllVisible;
+                } else if (((any_visible >> y) & 1u) == 0) {
+                    mask = 0;
+                } else {
+                    mask = 0;
+                    for (int f = 0; f < kFaceCount; ++f)
+                        mask |= ((faces[f] >> y) & 1u) << f;
+                }
+
+                block->face_visibility_ = FaceVisibility(mask);
+            }
         }
     }
+}
 
-    // right: +z
-    for (size_t x = 0; x < kChunkWidth; ++x) {
-        for (size_t y = 0; y < kChunkHeight; ++y) {
-            const size_t z = kChunkDepth - 1;
-            Block &block = (*this)[{x, y, z}];
-            neighbour_opacity_.right_[{x, y}] = BlockType_opaque(block.type_);
-        }
+void ChunkTerrain::populate_neighbour_opacity() {
+    for (size_t z = 0; z < kChunkDepth; ++z) {
+        neighbour_opacity_.back_[z] = column(kChunkWidth - 1, z); // +x
+        neighbour_opacity_.front_[z] = column(0, z); // -x
     }
 
-    // left: -z
     for (size_t x = 0; x < kChunkWidth; ++x) {
-        for (size_t y = 0; y < kChunkHeight; ++y) {
-            const size_t z = 0;
-            Block &block = (*this)[{x, y, z}];
-            neighbour_opacity_.left_[{x, y}] = BlockType_opaque(block.type_);
-        }
+        neighbour_opacity_.right_[x] = column(x, kChunkDepth - 1); // +z
+        neighbour_opacity_.left_[x] = column(x, 0); // -z
     }
 }
 
+void ChunkTerrain::set_column_face_visibility(size_t x, size_t z, Face face, ColumnMask visible) {
+    Block *block = &grid_[{x, 0, z}];
+    for (size_t y = 0; y < kChunkHeight; ++y, block += kChunkDepth)
+        block->face_visibility_.set_face_visible(face, (visible >> y) & 1u);
+}
+
 void ChunkTerrain::merge_faces(const ChunkTerrain &neighbour, ChunkNeighbour side) {
     // local copy to avoid constantly reading from neighbour
     auto n_opacity = neighbour.neighbour_opacity_;
 
     switch (*side) {
         case ChunkNeighbour::kBack:
-            for (size_t y = 0; y < kChunkHeight; ++y) {
-                for (size_t z = 0; z < kChunkDepth; ++z) {
-                    const size_t x = kChunkWidth - 1;
-                    bool n_opaque = n_opacity.front_[{y, z}];
-                    (*this)[{x, y, z}].face_visibility_.set_face_visible(Face::kBack, !n_opaque);
-                }
-            }
+            for (size_t z = 0; z < kChunkDepth; ++z)
+                set_column_face_visibility(kChunkWidth - 1, z, Face::kBack, ~n_opacity.front_[z]);
             break;
 
         case ChunkNeighbour::kFront:
-            for (size_t y = 0; y < kChunkHeight; ++y) {
-                for (size_t z = 0; z < kChunkDepth; ++z) {
-                    const size_t x = 0;
-                    bool n_opaque = n_opacity.back_[{y, z}];
-                    (*this)[{x, y, z}].face_visibility_.set_face_visible(Face::kFront, !n_opaque);
-                }
-            }
+            for (size_t z = 0; z < kChunkDepth; ++z)
+                set_column_face_visibility(0, z, Face::kFront, ~n_opacity.back_[z]);
             break;
 
         case ChunkNeighbour::kRight:
-            for (size_t x = 0; x < kChunkWidth; ++x) {
-                for (size_t y = 0; y < kChunkHeight; ++y) {
-                    const size_t z = kChunkDepth - 1;
-                    bool n_opaque = n_opacity.left_[{x, y}];
-                    (*this)[{x, y, z}].face_visibility_.set_face_visible(Face::kRight, !n_opaque);
-
-                }
-            }
+            for (size_t x = 0; x < kChunkWidth; ++x)
+                set_column_face_visibility(x, kChunkDepth - 1, Face::kRight, ~n_opacity.left_[x]);
             break;
 
         case ChunkNeighbour::kLeft:
-            for (size_t x = 0; x < kChunkWidth; ++x) {
-                for (size_t y = 0; y < kChunkHeight; ++y) {
-                    const size_t z = 0;
-                    bool n_opaque = n_opacity.right_[{x, y}];
-                    (*this)[{x, y, z}].face_visibility_.set_face_visible(Face::kLeft, !n_opaque);
-                }
-            }
+            for (size_t x = 0; x < kChunkWidth; ++x)
+                set_column_face_visibility(x, 0, Face::kLeft, ~n_opacity.right_[x]);
             break;
     }
 
     merged_sides_[*side] = true;
 }
-
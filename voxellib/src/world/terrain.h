@@ -3,6 +3,7 @@
 
 #include <array>
 #include <bitset>
+#include <cstdint>
 
 #include "multidim_grid.hpp"
 #include "block.h"
@@ -46,9 +47,36 @@ public:
 
     Block &operator[](unsigned int flat_index);
 
+    const Block &operator[](unsigned int flat_index) const;
+
     Block &operator[](const GridType::ArrayCoord &coord);
 
-    void expand(unsigned int index, BlockCoord &out);
+    const Block &operator[](const GridType::ArrayCoord &coord) const;
+
+    // packed blocks in flat index order, kBlocksPerChunk long
+    inline Block *blocks() { return grid_.begin(); }
+
+    inline const Block *blocks() const { return grid_.begin(); }
+
+    constexpr static size_t kBlocksSizeBytes = kBlocksPerChunk * sizeof(Block);
+
+    // bit y set if the block at y in an (x, z) column is opaque
+    typedef uint64_t ColumnMask;
+    static_assert(sizeof(ColumnMask) * 8 == kChunkHeight, "a column must fit exactly in a ColumnMask");
+
+    /**
+     * Sets the block type and keeps the column opacity in sync.
+     * Anything that writes block types directly must call rebuild_opacity() afterwards
+     */
+    void set_type(const BlockCoord &coord, BlockType type);
+
+    void set_type(unsigned int flat_index, BlockType type);
+
+    inline ColumnMask column(size_t x, size_t z) const { return opacity_[x * kChunkDepth + z]; }
+
+    void rebuild_opacity();
+
+    void expand(unsigned int index, BlockCoord &out) const;
 
     void update_face_visibility();
 
@@ -61,31 +89,21 @@ public:
     inline void reset_merged_faces() { merged_sides_.reset(); }
 
 private:
-    GridType grid_;
-
-    template<size_t dim1, size_t dim2>
-    struct NeighbourOpacity {
-        typedef bool Bit; // TODO bits instead of huge bools
-        typedef multidim::Grid<Bit, dim1, dim2> OpacityGridType;
+    friend class ChunkRecord;
+    friend class TerrainDecoder;
 
-        NeighbourOpacity() = default;
-        NeighbourOpacity(const NeighbourOpacity &o) : grid_(o.grid_) {}
-
-        constexpr inline Bit &operator[](const typename OpacityGridType::ArrayCoord &coord) {
-            return grid_[coord];
-        }
+    GridType grid_;
 
-        constexpr inline Bit operator[](const typename OpacityGridType::ArrayCoord &coord) const {
-            return grid_[coord];
-        }
+    // indexed by x * kChunkDepth + z
+    std::array<ColumnMask, kChunkWidth * kChunkDepth> opacity_{};
 
-    private:
-        OpacityGridType grid_;
-    };
+    // sets face visibility of every block in the column from the corresponding bit in visible
+    void set_column_face_visibility(size_t x, size_t z, Face face, ColumnMask visible);
 
+    // copies of the columns along each edge, for neighbours to merge with
     struct {
-        NeighbourOpacity<kChunkHeight, kChunkDepth> back_, front_;
-        NeighbourOpacity<kChunkWidth, kChunkHeight> left_, right_;
+        std::array<ColumnMask, kChunkDepth> back_{}, front_{};
+        std::array<ColumnMask, kChunkWidth> left_{}, right_{};
     } neighbour_opacity_;
 
     std::bitset<ChunkNeighbour::kCount> merged_sides_;
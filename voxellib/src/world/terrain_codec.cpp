@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "error.h"
+#include "terrain_codec.h"
+
+static_assert(kChunkHeight <= 255, "run lengths must fit in a byte");
+
+constexpr size_t TerrainEncoder::kColumns;
+
+static inline size_t block_key(const Block &block) {
+    return (static_cast<size_t>(block.type_) << kFaceCount) | block.face_visibility_.mask();
+}
+
+// bottom block of the column, the column continues every kChunkDepth blocks
+static inline size_t column_base(size_t column) {
+    size_t x = column / kChunkDepth, z = column % kChunkDepth;
+    return x * kChunkHeight * kChunkDepth + z;
+}
+
+TerrainEncoder::TerrainEncoder(const ChunkTerrain &terrain) : terrain_(terrain) {
+    std::array<bool, kTerrainPaletteMax> seen{};
+    uint16_t palette_len = 0;
+    staged_.resize(sizeof(palette_len));
+
+    // palette in order of first appearance
+    const Block *blocks = terrain_.blocks();
+    for (size_t i = 0; i < kBlocksPerChunk; ++i) {
+        size_t key = block_key(blocks[i]);
+        assert(key < kTerrainPaletteMax);
+        if (!seen[key]) {
+            seen[key] = true;
+            indices_[key] = static_cast<uint8_t>(palette_len++);
+            staged_.push_back(static_cast<uint8_t>(blocks[i].type_));
+            staged_.push_back(blocks[i].face_visibility_.mask());
+        }
+    }
+
+    memcpy(staged_.data(), &palette_len, sizeof(palette_len));
+}
+
+size_t TerrainEncoder::read(uint8_t *out, size_t capacity) {
+    size_t written = 0;
+    while (written < capacity) {
+        if (staged_pos_ == staged_.size()) {
+            if (next_column_ == kColumns)
+                break;
+
+            stage_column(next_column_++);
+        }
+
+        size_t n = std::min(capacity - written, staged_.size() - staged_pos_);
+        memcpy(out + written, staged_.data() + staged_pos_, n);
+        staged_pos_ += n;
+        written += n;
+    }
+
+    return written;
+}
+
+void TerrainEncoder::encode(const ChunkTerrain &terrain, std::vector<uint8_t> &out) {
+    TerrainEncoder encoder(terrain);
+
+    // the palette, then columns straight into out
+    out.insert(out.end(), encoder.staged_.begin(), encoder.staged_.end());
+    for (size_t column = 0; column < kColumns; ++column) {
+        encoder.stage_column(column);
+        out.insert(out.end(), encoder.staged_.begin(), encoder.staged_.end());
+    }
+}
+
+void TerrainEncoder::stage_column(size_t column) {
+    staged_.clear();
+    staged_pos_ = 0;
+
+    const Block *block = terrain_.blocks() + column_base(column);
+    size_t y = 0;
+    while (y < kChunkHeight) {
+        size_t key = block_key(*block);
+        size_t run = 1;
+        while (y + run < kChunkHeight && block_key(block[run * kChunkDepth]) == key)
+            run++;
+
+        staged_.push_back(indices_[key]);
+        staged_.push_back(static_cast<uint8_t>(run));
+        block += run * kChunkDepth;
+        y += run;
+    }
+}
+
+TerrainDecoder::TerrainDecoder(ChunkTerrain &terrain_out) : terrain_(terrain_out) {}
+
+int TerrainDecoder::decode(const uint8_t *data, size_t size, ChunkTerrain &terrain_out) {
+    TerrainDecoder decoder(terrain_out);
+    int ret = decoder.write(data, size);
+    if (ret != kErrorSuccess)
+        return ret;
+
+    return decoder.done() ? kErrorSuccess : kErrorFormat;
+}
+
+int TerrainDecoder::fail() {
+    state_ = kError;
+    return kErrorFormat;
+}
+
+int TerrainDecoder::write(const uint8_t *data, size_t size) {
+    if (state_ == kError)
+        return kErrorFormat;
+
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t b = data[i];
+
+        switch (state_) {
+            case kPaletteLength: {
+                partial_[partial_len_++] = b;
+                if (partial_len_ < 2)
+                    break;
+
+                uint16_t len;
+                memcpy(&len, partial_, sizeof(len));
+                partial_len_ = 0;
+                if (len == 0 || len > kTerrainPaletteMax)
+                    return fail();
+
+                palette_len_ = len;
+                palette_.reserve(len);
+                state_ = kPalette;
+                break;
+            }
+
+            case kPalette: {
+                partial_[partial_len_++] = b;
+                if (partial_len_ < 2)
+                    break;
+
+                partial_len_ = 0;
+                if (partial_[0] >= kBlockTypeCount || partial_[1] > FaceVisibility::kAllVisible)
+                    return fail();
+
+                Block block(static_cast<BlockType>(partial_[0]));
+                block.face_visibility_ = FaceVisibility(partial_[1]);
+                palette_.push_back(block);
+
+                if (palette_.size() == palette_len_)
+                    state_ = kRunIndex;
+                break;
+            }
+
+            case kRunIndex:
+                if (b >= palette_.size())
+                    return fail();
+
+                run_index_ = b;
+                state_ = kRunLength;
+                break;
+
+            case kRunLength: {
+                if (b == 0 || y_ + b > kChunkHeight)
+                    return fail();
+
+                const Block block = palette_[run_index_];
+                Block *out = terrain_.blocks() + column_base(column_) + y_ * kChunkDepth;
+                for (size_t n = 0; n < b; ++n, out += kChunkDepth)
+                    *out = block;
+
+                if (BlockType_opaque(block.type_)) {
+                    ChunkTerrain::ColumnMask run = b == kChunkHeight ? ~ChunkTerrain::ColumnMask(0)
+                                                                     : (ChunkTerrain::ColumnMask(1) << b) - 1;
+                    opacity_ |= run << y_;
+                }
+
+                y_ += b;
+                state_ = kRunIndex;
+
+                if (y_ == kChunkHeight) {
+                    terrain_.opacity_[column_] = opacity_;
+                    opacity_ = 0;
+                    y_ = 0;
+                    if (++column_ == kChunkWidth * kChunkDepth)
+                        state_ = kDone;
+                }
+                break;
+            }
+
+            case kDone:
+            case kError:
+                return fail();
+        }
+    }
+
+    return kErrorSuccess;
+}
@@ -0,0 +1,96 @@
+#ifndef VOXELS_TERRAIN_CODEC_H
+#define VOXELS_TERRAIN_CODEC_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "terrain.h"
+
+// possible distinct blocks, which all fit in a u8 palette index
+constexpr size_t kTerrainPaletteMax = size_t(kBlockTypeCount) << kFaceCount;
+static_assert(kTerrainPaletteMax <= 256, "palette indices must fit in a byte");
+
+/**
+ * Compact encoding of a chunk's blocks. Every distinct block (type and face mask) is put in a palette, then
+ * each (x, z) column is run length encoded from the bottom up, as generated terrain is mostly long runs of
+ * hidden solid blocks under long runs of air.
+ *
+ * Layout: u16 palette length, then 2 bytes per palette entry (type, face mask), then for every column in
+ * x * kChunkDepth + z order its runs as (u8 palette index, u8 length) pairs adding up to kChunkHeight.
+ * Border opacity and merged sides are not included.
+ *
+ * The encoding is pulled out a piece at a time, e.g. into a fixed size network buffer
+ */
+class TerrainEncoder {
+public:
+    // the terrain must not change until done
+    explicit TerrainEncoder(const ChunkTerrain &terrain);
+
+    // copies up to capacity bytes into out, returning how many. 0 once done
+    size_t read(uint8_t *out, size_t capacity);
+
+    inline bool done() const { return staged_pos_ == staged_.size() && next_column_ == kColumns; }
+
+    // appends the full encoding
+    static void encode(const ChunkTerrain &terrain, std::vector<uint8_t> &out);
+
+private:
+    static constexpr size_t kColumns = kChunkWidth * kChunkDepth;
+
+    const ChunkTerrain &terrain_;
+
+    // palette index of each distinct block, by type << kFaceCount | face mask
+    std::array<uint8_t, kTerrainPaletteMax> indices_;
+
+    // encoded but not yet read, starting with the palette
+    std::vector<uint8_t> staged_;
+    size_t staged_pos_ = 0;
+    size_t next_column_ = 0;
+
+    void stage_column(size_t column);
+};
+
+// accepts the encoding a piece at a time, split anywhere
+class TerrainDecoder {
+public:
+    // blocks and column opacity are written as each column completes
+    explicit TerrainDecoder(ChunkTerrain &terrain_out);
+
+    // kErrorFormat if malformed or continuing past the end, and for every call after that
+    int write(const uint8_t *data, size_t size);
+
+    inline bool done() const { return state_ == kDone; }
+
+    // data must be exactly one encoding
+    static int decode(const uint8_t *data, size_t size, ChunkTerrain &terrain_out);
+
+private:
+    enum State {
+        kPaletteLength,
+        kPalette,
+        kRunIndex,
+        kRunLength,
+        kDone,
+        kError,
+    };
+
+    ChunkTerrain &terrain_;
+    State state_ = kPaletteLength;
+
+    // multi byte fields in progress
+    uint8_t partial_[2];
+    int partial_len_ = 0;
+
+    size_t palette_len_ = 0;
+    std::vector<Block> palette_;
+
+    size_t column_ = 0;
+    size_t y_ = 0;
+    uint8_t run_index_ = 0;
+    ChunkTerrain::ColumnMask opacity_ = 0;
+
+    int fail();
+};
+
+#endif
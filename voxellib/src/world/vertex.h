@@ -0,0 +1,112 @@
+#ifndef VOXELS_VERTEX_H
+#define VOXELS_VERTEX_H
+
+#include <cstdint>
+#include "block.h"
+#include "face.h"
+#include "constants.h"
+
+/**
+ * Chunk mesh vertex packed into a single word, unpacked by world.glslv
+ *
+ * Positions are block corners in chunk space, so 0..kChunkWidth inclusive etc.
+ * Colour is looked up from a palette uniform by block type.
+ *
+ * | x:5 | y:7 | z:5 | face:3 | block type:8 | unused:4 |
+ */
+typedef uint32_t PackedVertex;
+
+const unsigned int kVertexXBits = 5;
+const unsigned int kVertexYBits = 7;
+const unsigned int kVertexZBits = 5;
+const unsigned int kVertexFaceBits = 3;
+const unsigned int kVertexTypeBits = 8;
+
+const unsigned int kVertexXShift = 0;
+const unsigned int kVertexYShift = kVertexXShift + kVertexXBits;
+const unsigned int kVertexZShift = kVertexYShift + kVertexYBits;
+const unsigned int kVertexFaceShift = kVertexZShift + kVertexZBits;
+const unsigned int kVertexTypeShift = kVertexFaceShift + kVertexFaceBits;
+
+static_assert(kVertexTypeShift + kVertexTypeBits <= 32, "vertex must fit in 32 bits");
+static_assert(kChunkWidth < (1 << kVertexXBits) && kChunkHeight < (1 << kVertexYBits) &&
+              kChunkDepth < (1 << kVertexZBits), "corner coords must fit in their fields");
+static_assert(kFaceCount <= (1 << kVertexFaceBits), "face must fit in its field");
+
+// size of the palette uniform in world.glslv
+const int kBlockPaletteSize = 16;
+static_assert(kBlockTypeCount <= kBlockPaletteSize, "palette is too small for all block types");
+
+constexpr inline uint32_t vertex_field_mask(unsigned int bits) { return (1u << bits) - 1; }
+
+inline PackedVertex pack_vertex(unsigned int x, unsigned int y, unsigned int z, Face face, BlockType type) {
+    return (x & vertex_field_mask(kVertexXBits)) << kVertexXShift |
+           (y & vertex_field_mask(kVertexYBits)) << kVertexYShift |
+           (z & vertex_field_mask(kVertexZBits)) << kVertexZShift |
+           (static_cast<uint32_t>(face) & vertex_field_mask(kVertexFaceBits)) << kVertexFaceShift |
+           (static_cast<uint32_t>(type) & vertex_field_mask(kVertexTypeBits)) << kVertexTypeShift;
+}
+
+inline void unpack_vertex(PackedVertex v, unsigned int &x, unsigned int &y, unsigned int &z, Face &face,
+                          BlockType &type) {
+    x = (v >> kVertexXShift) & vertex_field_mask(kVertexXBits);
+    y = (v >> kVertexYShift) & vertex_field_mask(kVertexYBits);
+    z = (v >> kVertexZShift) & vertex_field_mask(kVertexZBits);
+    face = static_cast<Face>((v >> kVertexFaceShift) & vertex_field_mask(kVertexFaceBits));
+    type = static_cast<BlockType>((v >> kVertexTypeShift) & vertex_field_mask(kVertexTypeBits));
+}
+
+// block corners per face, two triangles each, in the order of Face
+#define B kBlockRadius // for brevity
+const float kBlockVertices[] = {
+        // front
+        -B, -B, -B,
+        -B, -B, +B,
+        -B, +B, +B,
+        -B, +B, +B,
+        -B, +B, -B,
+        -B, -B, -B,
+
+        // left
+        +B, -B, -B,
+        -B, -B, -B,
+        -B, +B, -B,
+        -B, +B, -B,
+        +B, +B, -B,
+        +B, -B, -B,
+
+        // right
+        -B, -B, +B,
+        +B, -B, +B,
+        +B, +B, +B,
+        +B, +B, +B,
+        -B, +B, +B,
+        -B, -B, +B,
+
+        // top
+        -B, +B, -B,
+        -B, +B, +B,
+        +B, +B, +B,
+        +B, +B, +B,
+        +B, +B, -B,
+        -B, +B, -B,
+
+        // bottom
+        +B, -B, -B,
+        +B, -B, +B,
+        -B, -B, +B,
+        -B, -B, +B,
+        -B, -B, -B,
+        +B, -B, -B,
+
+        // back
+        +B, +B, -B,
+        +B, +B, +B,
+        +B, -B, +B,
+        +B, -B, +B,
+        +B, -B, -B,
+        +B, +B, -B,
+};
+#undef B
+
+#endif
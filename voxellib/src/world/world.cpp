@@ -10,7 +10,7 @@
 World::World(glm::vec3 spawn_pos, glm::vec3 spawn_dir) :
         spawn_{.position_=spawn_pos, .direction_=spawn_dir},
         loaded_chunk_radius_(config::kInitialLoadedChunkRadius) {
-    loader_ = WorldLoader::create(50);
+    loader_ = WorldLoader::create(kWorldSeed);
 }
 
 void World::register_camera(Camera *camera) {
@@ -31,11 +31,17 @@ void World::tick() {
 
     ChunkId_t centre_chunk;
     centre_.chunk(centre_chunk);
-    loader_->update_world_centre(centre_chunk, loaded_chunk_radius_);
+
+    // where the centre is heading, to load ahead of it
+    ChunkId_t heading_chunk = config::kPrefetchSeconds > 0 ?
+                              centre_.projected_chunk(config::kPrefetchSeconds) : centre_chunk;
+
+    loader_->update_world_centre(centre_chunk, loaded_chunk_radius_, heading_chunk);
 }
 
 void World::clear_all_chunks() {
-    loader_->unload_all_chunks();
+    // regenerated with the reloaded generator, not read back from disk
+    loader_->unload_all_chunks(true);
     NativeGenerator::mark_dirty();
 }
 
@@ -51,6 +57,7 @@ void World::tweak_loaded_chunk_radius(int delta) {
 }
 
 World::~World() {
-    loader_->unload_all_chunks();
+    // everything loaded is saved and on disk before returning, and nothing is loaded again
+    loader_->shutdown();
 }
 
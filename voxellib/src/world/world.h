@@ -29,10 +29,18 @@ public:
 
     inline int loaded_chunk_radius() const { return loaded_chunk_radius_; }
 
-    inline void get_renderable_chunks(std::vector<ChunkMesh *> &out) { loader_->get_renderable_chunks(out); }
+    // valid until finished_rendering
+    inline const RenderSnapshot &get_renderable_chunks() { return loader_->get_renderable_chunks(); }
 
     inline void finished_rendering() { loader_->finished_rendering(); }
 
+    // render thread, as returned by ChunkMesh::prepare_render
+    inline void track_gpu_bytes(int64_t delta) { loader_->track_gpu_bytes(delta); }
+
+    inline MemoryGovernor::Stats memory_stats() const { return loader_->memory_stats(); }
+
+    inline ChunkCache::Stats cache_stats() const { return loader_->cache_stats(); }
+
     inline void get_gl_goshdarn_garbage(std::vector<WorldLoader::GlGarbage> &out) {
         loader_->get_gl_goshdarn_garbage(out);
     }
@@ -33,6 +33,23 @@ int WorldRenderer::init(World *world) {
         return ret;
 
 
+    // constant uniforms for unpacking vertices
+    glUseProgram(prog_);
+    {
+        int loc = glGetUniformLocation(prog_, "block_size");
+        glUniform1f(loc, 2 * kBlockRadius);
+
+        // colours are stored as bytes r, g, b, a
+        GLfloat palette[kBlockPaletteSize * 4] = {0};
+        for (int i = 0; i < kBlockTypeCount; ++i) {
+            for (int c = 0; c < 4; ++c)
+                palette[i * 4 + c] = ((kBlockTypeColours[i] >> (c * 8)) & 0xff) / 255.f;
+        }
+
+        loc = glGetUniformLocation(prog_, "palette");
+        glUniform4fv(loc, kBlockPaletteSize, palette);
+    }
+
     glGenVertexArrays(1, &vao_);
     glBindVertexArray(vao_);
 
@@ -67,14 +84,14 @@ void WorldRenderer::render_world(const glm::mat4 &view) {
         glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(proj));
     }
 
-    // collect renderable chunks
-    renderables_.clear();
-    world_->get_renderable_chunks(renderables_);
+    // latest published renderable chunks, no copy
+    const RenderSnapshot &renderables = world_->get_renderable_chunks();
 
     glm::ivec3 world_transform;
-    for (ChunkMesh *mesh : renderables_) {
-        if (!mesh->prepare_render())
-            continue;
+    int64_t gpu_bytes = 0;
+    for (const RenderSnapshot::Entry &entry : renderables.entries_) {
+        ChunkMesh *mesh = entry.mesh_;
+        gpu_bytes += mesh->prepare_render(*entry.vertices_, entry.size_, entry.version_);
 
         // enable chunk
         // TODO can we use the same vao for all chunks?
@@ -83,17 +100,9 @@ void WorldRenderer::render_world(const glm::mat4 &view) {
 
         // enable attributes
         {
-            size_t word_size = sizeof(float);
-            size_t stride = kChunkMeshWordsPerVertexInstance * word_size;
-
-            // 0: pos
+            // 0: packed vertex, unpacked in shader
             glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, 0);
-
-            // 1: colour
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, true, stride, reinterpret_cast<const void *>(3L * word_size));
-
+            glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(PackedVertex), 0);
         }
 
         // update view with chunk world offset
@@ -101,11 +110,14 @@ void WorldRenderer::render_world(const glm::mat4 &view) {
         update_view(view, world_transform);
 
         // TODO instancing?
-        glDrawArrays(GL_TRIANGLES, 0, mesh->mesh_size());
+        glDrawArrays(GL_TRIANGLES, 0, entry.size_);
     }
 
     world_->finished_rendering();
 
+    if (gpu_bytes != 0)
+        world_->track_gpu_bytes(gpu_bytes);
+
     // clear gl garbage
     world_->get_gl_goshdarn_garbage(gl_garbage_);
     for (auto garbage : gl_garbage_) {
@@ -131,3 +143,23 @@ void WorldRenderer::update_view(const glm::mat4 &view, const glm::vec3 &world_tr
     int loc = glGetUniformLocation(prog_, "view");
     glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(translated_view));
 }
+
+// lives here rather than in chunk.cpp so chunks and meshing build without gl
+int64_t ChunkMesh::prepare_render(const ChunkMeshRaw &vertices, size_t size, uint64_t version) {
+    if (vao_ == 0 || vbo_ == 0) {
+        glGenBuffers(1, &vbo_);
+        glGenVertexArrays(1, &vao_);
+    }
+
+    if (version == uploaded_version_)
+        return 0;
+
+    uploaded_version_ = version;
+    size_t bytes = size * sizeof(PackedVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER, bytes, vertices.data(), GL_STATIC_DRAW);
+
+    int64_t delta = static_cast<int64_t>(bytes) - static_cast<int64_t>(gpu_bytes_);
+    gpu_bytes_ = bytes;
+    return delta;
+}
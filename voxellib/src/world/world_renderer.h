@@ -34,8 +34,6 @@ private:
     GLuint prog_, vao_, vbo_;
     bool wireframe_ = false;
 
-    // cleared and repopulated each frame
-    std::vector<ChunkMesh *> renderables_;
     std::vector<WorldLoader::GlGarbage> gl_garbage_;
 
     /**
@@ -47,56 +45,4 @@ private:
     void update_view(const glm::mat4 &view, const glm::vec3 &world_transform);
 };
 
-#define B kBlockRadius // for brevity
-const float kBlockVertices[] = {
-        // front
-        -B, -B, -B,
-        -B, -B, +B,
-        -B, +B, +B,
-        -B, +B, +B,
-        -B, +B, -B,
-        -B, -B, -B,
-
-        // left
-        +B, -B, -B,
-        -B, -B, -B,
-        -B, +B, -B,
-        -B, +B, -B,
-        +B, +B, -B,
-        +B, -B, -B,
-
-        // right
-        -B, -B, +B,
-        +B, -B, +B,
-        +B, +B, +B,
-        +B, +B, +B,
-        -B, +B, +B,
-        -B, -B, +B,
-
-        // top
-        -B, +B, -B,
-        -B, +B, +B,
-        +B, +B, +B,
-        +B, +B, +B,
-        +B, +B, -B,
-        -B, +B, -B,
-
-        // bottom
-        +B, -B, -B,
-        +B, -B, +B,
-        -B, -B, +B,
-        -B, -B, +B,
-        -B, -B, -B,
-        +B, -B, -B,
-
-        // back
-        +B, +B, -B,
-        +B, +B, +B,
-        +B, -B, +B,
-        +B, -B, +B,
-        +B, -B, -B,
-        +B, +B, -B,
-};
-#undef B
-
 #endif
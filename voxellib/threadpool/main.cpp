@@ -1,25 +1,54 @@
+#include <atomic>
 #include <boost/chrono.hpp>
 #include <boost/thread/thread.hpp>
-#include <iostream>
+#include <cstdio>
 
 #include "threadpool.h"
 
-int main() {
-    ThreadPool pool;
+// compares scheduling modes on short, bursty tasks, like chunk generation and meshing
+
+static const unsigned int kWorkerCounts[] = {1, 2, 4, 8, 16};
+static const int kBursts = 50;
+static const int kTasksPerBurst = 2000;
+
+// a few microseconds of work
+static void short_task() {
+    volatile int x[100];
+    for (int j = 0; j < 2000; ++j)
+        x[j % 100] = j;
+}
+
+// returns tasks per second
+static double run(SchedulingMode mode, unsigned int workers) {
+    ThreadPool pool(workers, mode);
+    std::atomic_int done(0);
+    int expected = 0;
 
     auto start = boost::chrono::steady_clock::now();
-    for (int i = 0; i < 1000; ++i) {
-        pool.post([i]() {
-            int x[100];
-            for (int j = 0; j < 1000000; ++j) {
-                x[j % 100] = j;
-            }
-        });
+    for (int burst = 0; burst < kBursts; ++burst) {
+        for (int i = 0; i < kTasksPerBurst; ++i) {
+            pool.post([&done]() {
+                short_task();
+                done++;
+            }, i % 16);
+        }
+
+        // drain between bursts so workers go idle and have to be woken again
+        expected += kTasksPerBurst;
+        while (done < expected)
+            boost::this_thread::yield();
     }
-//    pool.post_batch_end();
+    auto end = boost::chrono::steady_clock::now();
 
-    while (!pool.empty());
+    double secs = boost::chrono::duration<double>(end - start).count();
+    return expected / secs;
+}
 
-    auto end = boost::chrono::steady_clock::now();
-    std::cout << boost::chrono::duration_cast<boost::chrono::milliseconds>(end - start) << std::endl;
-}
\ No newline at end of file
+int main() {
+    printf("%8s %14s %14s %8s\n", "workers", "shared/s", "stealing/s", "speedup");
+    for (unsigned int workers : kWorkerCounts) {
+        double shared = run(kSchedulingShared, workers);
+        double stealing = run(kSchedulingWorkStealing, workers);
+        printf("%8u %14.0f %14.0f %7.2fx\n", workers, shared, stealing, stealing / shared);
+    }
+}
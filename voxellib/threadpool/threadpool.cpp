@@ -1,17 +1,149 @@
+#include <algorithm>
 #include <boost/thread/thread.hpp>
 #include <vector>
 #include "threadpool.h"
 #include "../lib/loguru/loguru.hpp"
 
-ThreadPool::ThreadPool(unsigned int threads) : run_(true), workers_(threads) {
+// the pool and queue of the worker running on this thread, if any
+static thread_local struct {
+    const ThreadPool *pool_ = nullptr;
+    unsigned int queue_;
+} current_worker;
+
+ThreadPool::ThreadPool(unsigned int threads, SchedulingMode mode) : mode_(mode), run_(true), workers_(threads) {
     if (threads == 0) throw std::runtime_error("thread must be > 0");
+
+    if (mode_ == kSchedulingWorkStealing) {
+        queues_.reserve(threads);
+        for (int i = 0; i < threads; ++i)
+            queues_.emplace_back(new WorkerQueue);
+    }
+
     for (int i = 0; i < threads; ++i) {
-        workers_[i] = boost::thread(Worker(*this));
+        workers_[i] = boost::thread(Worker(*this, i));
     }
 }
 
 ThreadPool::ThreadPool() : ThreadPool(hardware_concurrency()) {}
 
+void TaskQueue::push(QueuedTask &&task, Priority priority, TaskTag tag, CancellationTokenPtr token) {
+    heap_.push_back({std::move(task), priority, tag, next_seq_++, std::move(token)});
+    std::push_heap(heap_.begin(), heap_.end(), Compare());
+}
+
+bool TaskQueue::pop(QueuedTask &out) {
+    while (!heap_.empty()) {
+        std::pop_heap(heap_.begin(), heap_.end(), Compare());
+        Entry &e = heap_.back();
+
+        bool run = e.token_ == nullptr || e.token_->begin();
+        if (run)
+            out = std::move(e.task_);
+
+        heap_.pop_back();
+        if (run)
+            return true;
+    }
+
+    return false;
+}
+
+void TaskQueue::reprioritise(const Reprioritiser &reprioritiser) {
+    heap_.erase(std::remove_if(heap_.begin(), heap_.end(), [](const Entry &e) {
+        return e.token_ != nullptr && e.token_->cancelled();
+    }), heap_.end());
+
+    for (Entry &e : heap_) {
+        if (e.tag_ != kUntagged)
+            e.priority_ = reprioritiser(e.tag_, e.priority_);
+    }
+
+    std::make_heap(heap_.begin(), heap_.end(), Compare());
+}
+
+bool ThreadPool::empty() {
+    if (mode_ == kSchedulingWorkStealing)
+        return queued_ == 0;
+
+    boost::lock_guard<boost::mutex> lock(wait_mutex_);
+    return tasks_.empty();
+}
+
+void ThreadPool::push(QueuedTask &&task, Priority priority, TaskTag tag, CancellationTokenPtr &&token, bool notify) {
+    if (mode_ == kSchedulingShared) {
+        {
+            boost::lock_guard<boost::mutex> lock(wait_mutex_);
+            tasks_.push(std::move(task), priority, tag, std::move(token));
+        }
+        if (notify)
+            wait_.notify_one();
+        return;
+    }
+
+    // workers keep what they post, everyone else spreads tasks round robin
+    unsigned int queue = current_worker.pool_ == this
+                         ? current_worker.queue_
+                         : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
+    // counted before it is visible so a fast pop can't take queued_ below zero
+    queued_++;
+    {
+        WorkerQueue &q = *queues_[queue];
+        boost::lock_guard<boost::mutex> lock(q.lock_);
+        q.tasks_.push(std::move(task), priority, tag, std::move(token));
+    }
+
+    // a worker increments sleeping_ before checking queued_, so either it sees this task or we see it sleeping
+    if (notify && sleeping_ > 0) {
+        boost::lock_guard<boost::mutex> lock(wait_mutex_);
+        wait_.notify_one();
+    }
+}
+
+void ThreadPool::post_batch_end() {
+    if (mode_ == kSchedulingWorkStealing) {
+        if (sleeping_ == 0)
+            return;
+        boost::lock_guard<boost::mutex> lock(wait_mutex_);
+        wait_.notify_all();
+    } else {
+        wait_.notify_all();
+    }
+}
+
+bool ThreadPool::pop_from(unsigned int queue, QueuedTask &out, bool block) {
+    WorkerQueue &q = *queues_[queue];
+    boost::unique_lock<boost::mutex> lock(q.lock_, boost::defer_lock);
+    if (block)
+        lock.lock();
+    else if (!lock.try_lock())
+        return false;
+
+    if (q.tasks_.empty())
+        return false;
+
+    // cancelled tasks are dropped too
+    size_t before = q.tasks_.size();
+    bool popped = q.tasks_.pop(out);
+    queued_ -= before - q.tasks_.size();
+    return popped;
+}
+
+void ThreadPool::reprioritise(const Reprioritiser &reprioritiser) {
+    if (mode_ == kSchedulingShared) {
+        boost::lock_guard<boost::mutex> lock(wait_mutex_);
+        tasks_.reprioritise(reprioritiser);
+        return;
+    }
+
+    for (auto &q : queues_) {
+        boost::lock_guard<boost::mutex> lock(q->lock_);
+        size_t before = q->tasks_.size();
+        q->tasks_.reprioritise(reprioritiser);
+        queued_ -= before - q->tasks_.size();
+    }
+}
+
 unsigned int ThreadPool::hardware_concurrency() {
     return boost::thread::hardware_concurrency() * 2;
 }
@@ -20,7 +152,10 @@ void ThreadPool::shutdown() {
     if (!run_)
         return;
 
-    run_ = false;
+    {
+        boost::lock_guard<boost::mutex> lock(wait_mutex_);
+        run_ = false;
+    }
     wait_.notify_all();
 
     for (auto &w : workers_)
@@ -29,17 +164,24 @@ void ThreadPool::shutdown() {
 
 }
 
-ThreadPool::Worker::Worker(ThreadPool &pool) : pool_(pool) {
+ThreadPool::Worker::Worker(ThreadPool &pool, unsigned int index) : pool_(pool), index_(index) {
 
 }
 
 void ThreadPool::Worker::operator()() {
+    if (pool_.mode_ == kSchedulingWorkStealing)
+        run_work_stealing();
+    else
+        run_shared();
+}
+
+void ThreadPool::Worker::run_shared() {
     QueuedTask task;
     bool pop;
     while (pool_.run_) {
         {
             boost::unique_lock<boost::mutex> lock(pool_.wait_mutex_);
-            if (pool_.tasks_.empty())
+            while (pool_.run_ && pool_.tasks_.empty())
                 pool_.wait_.wait(lock);
 
             pop = pool_.tasks_.pop(task);
@@ -49,3 +191,39 @@ void ThreadPool::Worker::operator()() {
             task();
     }
 }
+
+void ThreadPool::Worker::run_work_stealing() {
+    current_worker.pool_ = &pool_;
+    current_worker.queue_ = index_;
+
+    const unsigned int count = pool_.queues_.size();
+    QueuedTask task;
+    while (pool_.run_) {
+        // own queue first
+        bool pop = pool_.pop_from(index_, task, true);
+
+        // then steal, skipping queues that are busy rather than waiting on them
+        for (unsigned int i = 1; !pop && i < count; ++i)
+            pop = pool_.pop_from((index_ + i) % count, task, false);
+
+        if (pop) {
+            task();
+            continue;
+        }
+
+        // queues were busy or a task is mid-push, try again shortly
+        if (pool_.queued_ > 0) {
+            boost::this_thread::yield();
+            continue;
+        }
+
+        // only sleep if there is really nothing left anywhere
+        boost::unique_lock<boost::mutex> lock(pool_.wait_mutex_);
+        pool_.sleeping_++;
+        while (pool_.run_ && pool_.queued_ == 0)
+            pool_.wait_.wait(lock);
+        pool_.sleeping_--;
+    }
+
+    current_worker.pool_ = nullptr;
+}
@@ -1,65 +1,182 @@
 #ifndef VOXELS_THREADPOOL_H
 #define VOXELS_THREADPOOL_H
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <utility>
+#include <vector>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/thread.hpp>
 
-// linked fifo
-#include <cstddef>
-#include <exception>
+// 0 is highest priority
+typedef unsigned int Priority;
+const Priority kDefaultPriority = 10;
 
-#include "spmc/LinkedFIFO.h"
+// caller defined id of a task, used to reprioritise it while queued
+typedef uint64_t TaskTag;
+const TaskTag kUntagged = UINT64_MAX;
 
-typedef unsigned int Priority;
 typedef std::function<void()> QueuedTask;
-typedef dkit::spmc::LinkedFIFO<QueuedTask> TaskQueue;
+
+// shared between whoever posts a task and the pool
+class CancellationToken {
+public:
+    // returns true if the task will now never run, false if it has already started
+    inline bool cancel() { return transition(kCancelled); }
+
+    // called by the pool before running the task, returns false if cancelled
+    inline bool begin() { return transition(kStarted); }
+
+    inline bool cancelled() const { return state_ == kCancelled; }
+
+private:
+    enum State : uint8_t {
+        kPending,
+        kStarted,
+        kCancelled,
+    };
+
+    std::atomic<uint8_t> state_{kPending};
+
+    inline bool transition(State to) {
+        uint8_t expected = kPending;
+        return state_.compare_exchange_strong(expected, to);
+    }
+};
+
+typedef std::shared_ptr<CancellationToken> CancellationTokenPtr;
+
+// called with the tag and current priority of each queued tagged task, returns its new priority
+typedef std::function<Priority(TaskTag, Priority)> Reprioritiser;
+
+// priority queue of tasks, FIFO within the same priority
+// not thread safe
+class TaskQueue {
+public:
+    void push(QueuedTask &&task, Priority priority, TaskTag tag, CancellationTokenPtr token);
+
+    // skips and drops cancelled tasks, returns false if empty
+    bool pop(QueuedTask &out);
+
+    inline bool empty() const { return heap_.empty(); }
+
+    inline size_t size() const { return heap_.size(); }
+
+    // also drops cancelled tasks
+    void reprioritise(const Reprioritiser &reprioritiser);
+
+private:
+    struct Entry {
+        QueuedTask task_;
+        Priority priority_;
+        TaskTag tag_;
+        uint64_t seq_;
+        CancellationTokenPtr token_;
+    };
+
+    // heap ordered so the highest priority, earliest posted task is at the front
+    struct Compare {
+        inline bool operator()(const Entry &a, const Entry &b) const {
+            return a.priority_ != b.priority_ ? a.priority_ > b.priority_ : a.seq_ > b.seq_;
+        }
+    };
+
+    std::vector<Entry> heap_;
+    uint64_t next_seq_ = 0;
+};
+
+enum SchedulingMode {
+    // one priority queue shared by all workers, strict priority order
+    kSchedulingShared,
+
+    // a priority queue per worker, idle workers steal from the others
+    // priority order is only per worker, but there is no single lock to fight over
+    kSchedulingWorkStealing,
+};
 
 class ThreadPool {
 public:
-    ThreadPool(unsigned int threads);
+    ThreadPool(unsigned int threads, SchedulingMode mode = kSchedulingShared);
 
     ThreadPool();
 
     inline ~ThreadPool() { shutdown(); }
 
-    inline bool empty() { return tasks_.empty(); }
+    bool empty();
+
+    inline SchedulingMode mode() const { return mode_; }
+
+    inline size_t size() const { return workers_.size(); }
 
     static unsigned int hardware_concurrency();
 
-    // 0 is highest priority
+    /**
+     * @param token If given and cancelled before a worker picks the task up, the task is dropped without running
+     */
     template<typename T>
-    void post(T &&task/*, Priority priority = 10*/) {
-        tasks_.push(task);
-        wait_.notify_one();
+    void post(T &&task, Priority priority = kDefaultPriority, TaskTag tag = kUntagged,
+              CancellationTokenPtr token = nullptr) {
+        push(QueuedTask(std::forward<T>(task)), priority, tag, std::move(token), true);
     }
 
+    // doesn't wake any workers until post_batch_end
     template<typename T>
-    void post_batch(T &&task/*, Priority priority = 10*/) {
-        tasks_.push(task);
+    void post_batch(T &&task, Priority priority = kDefaultPriority, TaskTag tag = kUntagged,
+                    CancellationTokenPtr token = nullptr) {
+        push(QueuedTask(std::forward<T>(task)), priority, tag, std::move(token), false);
     }
 
-    inline void post_batch_end() { wait_.notify_all(); }
+    void post_batch_end();
+
+    // updates the priority of all queued tagged tasks, e.g. when the world centre moves
+    void reprioritise(const Reprioritiser &reprioritiser);
 
     void shutdown();
 
 private:
-    TaskQueue tasks_;
+    SchedulingMode mode_;
+    std::atomic_bool run_;
+
+    // kSchedulingShared: guards tasks_
+    // kSchedulingWorkStealing: only used to sleep idle workers
     boost::condition_variable wait_;
     boost::mutex wait_mutex_;
 
+    // kSchedulingShared
+    TaskQueue tasks_;
+
+    // kSchedulingWorkStealing
+    struct alignas(64) WorkerQueue {
+        TaskQueue tasks_;
+        boost::mutex lock_;
+    };
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<unsigned int> sleeping_{0};
+    std::atomic<unsigned int> next_queue_{0};
+
     std::vector<boost::thread> workers_;
-    bool run_;
+
+    void push(QueuedTask &&task, Priority priority, TaskTag tag, CancellationTokenPtr &&token, bool notify);
+
+    // kSchedulingWorkStealing
+    bool pop_from(unsigned int queue, QueuedTask &out, bool block);
 
 
     struct Worker {
         ThreadPool &pool_;
+        unsigned int index_;
 
-        Worker(ThreadPool &pool);
+        Worker(ThreadPool &pool, unsigned int index);
 
         void operator()();
 
+        void run_shared();
+
+        void run_work_stealing();
+
     };
 };
 